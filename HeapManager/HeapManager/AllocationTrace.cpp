@@ -0,0 +1,205 @@
+#include "AllocationTrace.h"
+#include "VirtualMemory.h"
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+
+std::atomic<bool> s_AllocationTraceEnabled(false);
+
+// s_TraceMutex guards the file, the list of rings and the reading side of
+// every ring. Events written out while no file is open are dropped.
+static std::mutex s_TraceMutex;
+static FILE* s_pTraceFile = nullptr;
+static std::atomic<int64_t> s_TraceStartNs(0);
+static std::atomic<uint16_t> s_NextTraceThreadId(0);
+
+static int64_t GetTraceClockNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Single-producer ring of one thread's events. The thread appends at m_Head
+// without locking; whoever holds s_TraceMutex writes events out from m_Tail.
+// Both only ever increase, the slot is the count modulo s_Capacity. The events
+// are mapped from the OS so recording never allocates through the allocators
+// being traced.
+struct TraceRing
+{
+    static const size_t s_Capacity = 4096;
+
+    TraceEvent* m_pEvents = nullptr;
+    std::atomic<size_t> m_Head{ 0 };
+    std::atomic<size_t> m_Tail{ 0 };
+    uint16_t m_ThreadId = 0;
+    TraceRing* m_pNext = nullptr;
+    TraceRing* m_pPrev = nullptr;
+
+    ~TraceRing();
+};
+
+static TraceRing* s_pTraceRings = nullptr;
+
+// Set while this thread is inside the recorder, so allocations made by the
+// file calls aren't recorded into the ring being written out
+static thread_local bool t_InTrace = false;
+// Set once the thread's ring is gone; frees made by later thread_local
+// destructors aren't recorded
+static thread_local bool t_TraceRingDestroyed = false;
+static thread_local TraceRing t_TraceRing;
+
+struct TraceGuard
+{
+    TraceGuard() { t_InTrace = true; }
+    ~TraceGuard() { t_InTrace = false; }
+};
+
+// Writes out everything the ring holds; s_TraceMutex must be held
+static void WriteOutRing(TraceRing& ring)
+{
+    size_t tail = ring.m_Tail.load(std::memory_order_relaxed);
+    size_t head = ring.m_Head.load(std::memory_order_acquire);
+    while (tail != head)
+    {
+        size_t index = tail % TraceRing::s_Capacity;
+        size_t count = head - tail < TraceRing::s_Capacity - index ? head - tail : TraceRing::s_Capacity - index;
+        if (s_pTraceFile)
+        {
+            fwrite(&ring.m_pEvents[index], sizeof(TraceEvent), count, s_pTraceFile);
+        }
+        tail += count;
+    }
+    ring.m_Tail.store(tail, std::memory_order_release);
+}
+
+static bool RegisterRing(TraceRing& ring)
+{
+    void* pEvents = MapVirtualMemory(TraceRing::s_Capacity * sizeof(TraceEvent));
+    if (!pEvents)
+        return false;
+
+    ring.m_pEvents = static_cast<TraceEvent*>(pEvents);
+    ring.m_ThreadId = s_NextTraceThreadId.fetch_add(1, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(s_TraceMutex);
+    ring.m_pNext = s_pTraceRings;
+    if (s_pTraceRings)
+    {
+        s_pTraceRings->m_pPrev = &ring;
+    }
+    s_pTraceRings = &ring;
+    return true;
+}
+
+TraceRing::~TraceRing()
+{
+    t_TraceRingDestroyed = true;
+    if (!m_pEvents)
+        return;
+
+    TraceGuard guard;
+    {
+        std::lock_guard<std::mutex> lock(s_TraceMutex);
+        WriteOutRing(*this);
+
+        if (m_pPrev)
+        {
+            m_pPrev->m_pNext = m_pNext;
+        }
+        else
+        {
+            s_pTraceRings = m_pNext;
+        }
+        if (m_pNext)
+        {
+            m_pNext->m_pPrev = m_pPrev;
+        }
+    }
+    ReleaseVirtualMemory(m_pEvents, s_Capacity * sizeof(TraceEvent));
+}
+
+void RecordTraceEvent(TraceEventKind kind, void* pObject, void* pOldObject, size_t size, size_t alignment)
+{
+    if (t_InTrace || t_TraceRingDestroyed || !s_AllocationTraceEnabled.load(std::memory_order_acquire))
+        return;
+
+    TraceGuard guard;
+    TraceRing& ring = t_TraceRing;
+    if (!ring.m_pEvents && !RegisterRing(ring))
+        return;
+
+    // A full ring is written out by its own thread, so nothing is lost
+    size_t head = ring.m_Head.load(std::memory_order_relaxed);
+    if (head - ring.m_Tail.load(std::memory_order_acquire) == TraceRing::s_Capacity)
+    {
+        std::lock_guard<std::mutex> lock(s_TraceMutex);
+        WriteOutRing(ring);
+    }
+
+    TraceEvent& event = ring.m_pEvents[head % TraceRing::s_Capacity];
+    event.Timestamp = static_cast<uint64_t>(GetTraceClockNs() - s_TraceStartNs.load(std::memory_order_relaxed));
+    event.ObjectId = reinterpret_cast<uintptr_t>(pObject);
+    event.OldObjectId = reinterpret_cast<uintptr_t>(pOldObject);
+    event.Size = size;
+    event.Alignment = static_cast<uint32_t>(alignment);
+    event.ThreadId = ring.m_ThreadId;
+    event.Kind = kind;
+    event.Reserved = 0;
+    ring.m_Head.store(head + 1, std::memory_order_release);
+}
+
+bool StartAllocationTrace(const char* pPath)
+{
+    TraceGuard guard;
+    std::lock_guard<std::mutex> lock(s_TraceMutex);
+    if (s_pTraceFile)
+    {
+        printf("Error: an allocation trace is already running.\n");
+        return false;
+    }
+
+    FILE* pFile = nullptr;
+#ifdef _WIN32
+    if (fopen_s(&pFile, pPath, "wb") != 0)
+    {
+        pFile = nullptr;
+    }
+#else
+    pFile = fopen(pPath, "wb");
+#endif
+    if (!pFile)
+    {
+        printf("Error: could not open trace file %s.\n", pPath);
+        return false;
+    }
+
+    TraceFileHeader header = { s_TraceFileMagic, s_TraceFileVersion, sizeof(TraceEvent), 0 };
+    fwrite(&header, sizeof(header), 1, pFile);
+
+    // Drop whatever a previous trace left behind in the rings
+    for (TraceRing* pRing = s_pTraceRings; pRing; pRing = pRing->m_pNext)
+    {
+        WriteOutRing(*pRing);
+    }
+
+    s_pTraceFile = pFile;
+    s_TraceStartNs.store(GetTraceClockNs(), std::memory_order_relaxed);
+    s_AllocationTraceEnabled.store(true, std::memory_order_release);
+    return true;
+}
+
+void StopAllocationTrace()
+{
+    TraceGuard guard;
+    s_AllocationTraceEnabled.store(false, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(s_TraceMutex);
+    if (!s_pTraceFile)
+        return;
+
+    for (TraceRing* pRing = s_pTraceRings; pRing; pRing = pRing->m_pNext)
+    {
+        WriteOutRing(*pRing);
+    }
+    fclose(s_pTraceFile);
+    s_pTraceFile = nullptr;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Binary trace of the malloc/new/free/delete/realloc calls made through the
+// memory system, for replaying real allocation patterns offline with
+// ReplayAllocationTrace. Each thread records into its own lock-free ring
+// buffer; a full ring is written out by its own thread, and StopAllocationTrace
+// writes out what's left in every thread's ring. Events racing with
+// StopAllocationTrace may be dropped.
+
+enum class TraceEventKind : uint8_t {
+    Alloc,      // ObjectId was returned for Size bytes
+    Free,       // ObjectId is about to be freed
+    Realloc     // OldObjectId was resized to Size bytes and is now ObjectId
+};
+
+// Objects are identified by their address, which is reused once they are
+// freed: the replay follows the events in timestamp order
+struct TraceEvent {
+    uint64_t Timestamp;         // nanoseconds since StartAllocationTrace
+    uint64_t ObjectId;
+    uint64_t OldObjectId;
+    uint64_t Size;
+    uint32_t Alignment;         // 0 when the caller didn't ask for one
+    uint16_t ThreadId;          // numbered in the order threads first recorded an event
+    TraceEventKind Kind;
+    uint8_t Reserved;
+};
+
+// The file is this header followed by TraceEvents, grouped by thread rather
+// than in timestamp order
+struct TraceFileHeader {
+    uint32_t Magic;
+    uint32_t Version;
+    uint32_t EventSize;
+    uint32_t Reserved;
+};
+
+static const uint32_t s_TraceFileMagic = 0x52544D48;   // "HMTR"
+static const uint32_t s_TraceFileVersion = 1;
+
+// Starts writing events to i_pPath, replacing the file; false if it can't be
+// opened or a trace is already running
+bool StartAllocationTrace(const char* i_pPath);
+void StopAllocationTrace();
+
+// Slow paths of the Trace* hooks below
+void RecordTraceEvent(TraceEventKind i_Kind, void* i_pObject, void* i_pOldObject, size_t i_Size, size_t i_Alignment);
+
+// Hooks for Allocators.cpp: one relaxed load when no trace is running
+extern std::atomic<bool> s_AllocationTraceEnabled;
+
+inline void* TraceAlloc(void* i_pObject, size_t i_Size, size_t i_Alignment = 0)
+{
+    if (s_AllocationTraceEnabled.load(std::memory_order_relaxed) && i_pObject)
+    {
+        RecordTraceEvent(TraceEventKind::Alloc, i_pObject, nullptr, i_Size, i_Alignment);
+    }
+    return i_pObject;
+}
+
+inline void TraceFree(void* i_pObject)
+{
+    if (s_AllocationTraceEnabled.load(std::memory_order_relaxed) && i_pObject)
+    {
+        RecordTraceEvent(TraceEventKind::Free, i_pObject, nullptr, 0, 0);
+    }
+}
+
+inline void* TraceRealloc(void* i_pObject, void* i_pOldObject, size_t i_Size)
+{
+    if (s_AllocationTraceEnabled.load(std::memory_order_relaxed) && i_pObject)
+    {
+        RecordTraceEvent(TraceEventKind::Realloc, i_pObject, i_pOldObject, i_Size, 0);
+    }
+    return i_pObject;
+}
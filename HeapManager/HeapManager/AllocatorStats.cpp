@@ -0,0 +1,68 @@
+#include "AllocatorStats.h"
+#include <mutex>
+
+// Every live ThreadStats, and the counts of the threads that have exited
+static std::mutex s_ThreadStatsMutex;
+static ThreadStats* s_pThreadStats = nullptr;
+static uint64_t s_RetiredAllocCount[s_NumSizeClasses];
+static uint64_t s_RetiredFreeCount[s_NumSizeClasses];
+
+ThreadStats::ThreadStats()
+    : m_pNext(nullptr), m_pPrev(nullptr)
+{
+    for (size_t i = 0; i < s_NumSizeClasses; ++i)
+    {
+        m_AllocCount[i].store(0, std::memory_order_relaxed);
+        m_FreeCount[i].store(0, std::memory_order_relaxed);
+    }
+
+    std::lock_guard<std::mutex> lock(s_ThreadStatsMutex);
+    m_pNext = s_pThreadStats;
+    if (s_pThreadStats)
+    {
+        s_pThreadStats->m_pPrev = this;
+    }
+    s_pThreadStats = this;
+}
+
+ThreadStats::~ThreadStats()
+{
+    std::lock_guard<std::mutex> lock(s_ThreadStatsMutex);
+    for (size_t i = 0; i < s_NumSizeClasses; ++i)
+    {
+        s_RetiredAllocCount[i] += m_AllocCount[i].load(std::memory_order_relaxed);
+        s_RetiredFreeCount[i] += m_FreeCount[i].load(std::memory_order_relaxed);
+    }
+
+    if (m_pPrev)
+    {
+        m_pPrev->m_pNext = m_pNext;
+    }
+    else
+    {
+        s_pThreadStats = m_pNext;
+    }
+    if (m_pNext)
+    {
+        m_pNext->m_pPrev = m_pPrev;
+    }
+}
+
+void ThreadStats::Sum(uint64_t allocCount[s_NumSizeClasses], uint64_t freeCount[s_NumSizeClasses])
+{
+    std::lock_guard<std::mutex> lock(s_ThreadStatsMutex);
+    for (size_t i = 0; i < s_NumSizeClasses; ++i)
+    {
+        allocCount[i] = s_RetiredAllocCount[i];
+        freeCount[i] = s_RetiredFreeCount[i];
+    }
+
+    for (ThreadStats* pStats = s_pThreadStats; pStats; pStats = pStats->m_pNext)
+    {
+        for (size_t i = 0; i < s_NumSizeClasses; ++i)
+        {
+            allocCount[i] += pStats->m_AllocCount[i].load(std::memory_order_relaxed);
+            freeCount[i] += pStats->m_FreeCount[i].load(std::memory_order_relaxed);
+        }
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include "SizeClasses.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Counters every allocator keeps about itself; read with GetStats()
+struct AllocatorStats {
+    size_t BytesInUse;
+    size_t PeakBytesInUse;
+    uint64_t AllocCount;
+    uint64_t FreeCount;
+};
+
+// Updates AllocatorStats for allocators whose callers already serialize
+// alloc/free, so plain adds are enough
+inline void CountAllocation(AllocatorStats& io_Stats, size_t i_Bytes, uint64_t i_Count = 1)
+{
+    io_Stats.BytesInUse += i_Bytes;
+    if (io_Stats.BytesInUse > io_Stats.PeakBytesInUse)
+    {
+        io_Stats.PeakBytesInUse = io_Stats.BytesInUse;
+    }
+    io_Stats.AllocCount += i_Count;
+}
+
+inline void CountFree(AllocatorStats& io_Stats, size_t i_Bytes, uint64_t i_Count = 1)
+{
+    io_Stats.BytesInUse -= i_Bytes;
+    io_Stats.FreeCount += i_Count;
+}
+
+// Per-thread size-class counters for the malloc/new fast path. Each thread
+// only writes its own, with relaxed stores and no read-modify-write, and
+// readers add up every registered thread. A thread's counts are folded into
+// a shared total when it exits.
+class ThreadStats
+{
+private:
+    std::atomic<uint64_t> m_AllocCount[s_NumSizeClasses];
+    std::atomic<uint64_t> m_FreeCount[s_NumSizeClasses];
+    ThreadStats* m_pNext;
+    ThreadStats* m_pPrev;
+
+    static void Bump(std::atomic<uint64_t>& io_Counter) { io_Counter.store(io_Counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); }
+
+public:
+    ThreadStats();
+    ~ThreadStats();
+
+    ThreadStats(const ThreadStats&) = delete;
+    ThreadStats& operator=(const ThreadStats&) = delete;
+
+    void CountAlloc(size_t i_SizeClass) { Bump(m_AllocCount[i_SizeClass]); }
+    void CountFree(size_t i_SizeClass) { Bump(m_FreeCount[i_SizeClass]); }
+
+    // Adds the counts of every thread, live or exited
+    static void Sum(uint64_t o_AllocCount[s_NumSizeClasses], uint64_t o_FreeCount[s_NumSizeClasses]);
+};
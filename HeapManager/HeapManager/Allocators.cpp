@@ -1,100 +1,511 @@
+#include "AllocationTrace.h"
+#include "AllocatorStats.h"
 #include "HeapManager.h"
-#include "FixedSizeAllocator.h"
+#include "HeapArena.h"
 #include "HeapManagerProxy.h"
-#include <cstdio>
-#include <inttypes.h>
-#include <malloc.h>
+#include "HugeAllocator.h"
+#include "PageMap.h"
+#include "Platform.h"
+#include "SizeClasses.h"
+#include "SlabAllocator.h"
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <new>
 
 // External global pointers for the allocators and heap manager
-extern FixedSizeAllocator* s_pAllocators[3];
-extern HeapManager* s_pHeapManager;
+extern SlabAllocator* s_pAllocators[s_NumSizeClasses];
+extern HeapArena* s_pHeapArenas[s_MaxHeapArenas];
+extern unsigned int s_NumHeapArenas;
+extern PageMap s_PageMap;
+extern HugeAllocator s_HugeAllocator;
+extern std::mutex s_MemorySystemMutex;
 
-// Overloaded operator new
-void* operator new(size_t requestedSize)
+// Per-thread stacks of small blocks for each size class. The common
+// malloc/free path only touches the calling thread's cache; the shared
+// allocators are refilled from and flushed to in batches under the lock.
+struct ThreadCache
+{
+    static const size_t s_Capacity = 32;
+    static const size_t s_BatchSize = 16;
+
+    void* m_Blocks[s_NumSizeClasses][s_Capacity] = {};
+    size_t m_Count[s_NumSizeClasses] = {};
+
+    ~ThreadCache()
+    {
+        Flush();
+    }
+
+    // Moves up to s_BatchSize blocks from the shared allocator into the cache
+    void Refill(size_t sizeClass)
+    {
+        std::lock_guard<std::mutex> lock(s_MemorySystemMutex);
+        if (!s_pAllocators[sizeClass])
+            return;
+
+        size_t& count = m_Count[sizeClass];
+        count += s_pAllocators[sizeClass]->AllocBatch(s_BatchSize - count, &m_Blocks[sizeClass][count]);
+    }
+
+    // Returns the oldest s_BatchSize blocks of a full cache to the shared allocator
+    void Release(size_t sizeClass)
+    {
+        std::lock_guard<std::mutex> lock(s_MemorySystemMutex);
+        s_pAllocators[sizeClass]->FreeBatch(m_Blocks[sizeClass], s_BatchSize);
+
+        m_Count[sizeClass] -= s_BatchSize;
+        for (size_t i = 0; i < m_Count[sizeClass]; ++i)
+        {
+            m_Blocks[sizeClass][i] = m_Blocks[sizeClass][i + s_BatchSize];
+        }
+    }
+
+    void Flush()
+    {
+        std::lock_guard<std::mutex> lock(s_MemorySystemMutex);
+        for (size_t sizeClass = 0; sizeClass < s_NumSizeClasses; ++sizeClass)
+        {
+            // Allocators already destroyed took their blocks with them
+            if (s_pAllocators[sizeClass])
+            {
+                s_pAllocators[sizeClass]->FreeBatch(m_Blocks[sizeClass], m_Count[sizeClass]);
+            }
+            m_Count[sizeClass] = 0;
+        }
+    }
+};
+
+static thread_local ThreadCache t_ThreadCache;
+
+// Per-size-class counts of the blocks handed out and returned by this thread
+static thread_local ThreadStats t_ThreadStats;
+
+void FlushThreadCache()
+{
+    t_ThreadCache.Flush();
+}
+
+// Threads are assigned an arena round-robin on their first heap allocation
+static std::atomic<unsigned int> s_NextArenaSlot(0);
+static thread_local unsigned int t_ArenaSlot = UINT_MAX;
+
+static HeapArena* GetThreadArena()
+{
+    if (t_ArenaSlot == UINT_MAX)
+    {
+        t_ArenaSlot = s_NextArenaSlot.fetch_add(1, std::memory_order_relaxed);
+    }
+    return s_pHeapArenas[t_ArenaSlot % s_NumHeapArenas];
+}
+
+// The page map names the arena; the range check rejects pointers on the
+// partial pages just outside the heap region
+static HeapArena* FindOwningArena(void* ptr, PageOwner owner)
+{
+    if (owner.Kind != PageOwnerKind::HeapArena || owner.Index >= s_NumHeapArenas)
+        return nullptr;
+
+    HeapArena* pArena = s_pHeapArenas[owner.Index];
+    return pArena->Contains(ptr) ? pArena : nullptr;
+}
+
+// Frees directly into the calling thread's own arena, otherwise queues the
+// block on the owner so the two threads never contend on one lock
+static void FreeToArena(HeapArena* pOwner, void* ptr)
+{
+    if (pOwner == GetThreadArena())
+    {
+        pOwner->free(ptr);
+    }
+    else
+    {
+        pOwner->RemoteFree(ptr);
+    }
+}
+
+// Pops a block of the size class from the thread cache, refilling it first
+// if needed; nullptr when the class has no memory for a new slab
+static void* AllocateSmall(size_t sizeClass)
+{
+    if (!s_pAllocators[sizeClass])
+        return nullptr;
+
+    ThreadCache& cache = t_ThreadCache;
+    if (cache.m_Count[sizeClass] == 0)
+    {
+        cache.Refill(sizeClass);
+    }
+    if (cache.m_Count[sizeClass] == 0)
+        return nullptr;
+
+    t_ThreadStats.CountAlloc(sizeClass);
+    return cache.m_Blocks[sizeClass][--cache.m_Count[sizeClass]];
+}
+
+// Pushes a small block onto the thread cache, flushing a batch if it is full
+static void FreeSmall(size_t sizeClass, void* ptr)
+{
+    ThreadCache& cache = t_ThreadCache;
+    if (cache.m_Count[sizeClass] == ThreadCache::s_Capacity)
+    {
+        cache.Release(sizeClass);
+    }
+    cache.m_Blocks[sizeClass][cache.m_Count[sizeClass]++] = ptr;
+    t_ThreadStats.CountFree(sizeClass);
+}
+
+// Small requests come from the size classes, huge ones get their own mapping
+// so they don't split up the arenas, and the rest go through this thread's
+// arena. Arena and huge blocks are 16-byte aligned, which covers max_align_t
+// and the default new alignment. The memory system must be initialized.
+static void* Allocate(size_t size)
+{
+    if (size <= s_MaxSmallObjectSize)
+    {
+        if (void* ptr = AllocateSmall(GetSizeClass(size)))
+            return ptr;
+        // No memory for a new slab, the arena may still fit it
+    }
+
+    if (s_HugeAllocator.IsHuge(size))
+        return s_HugeAllocator.alloc(size);
+    return GetThreadArena()->alloc(size);
+}
+
+// Like Allocate for alignments above the 8 bytes every size-class block has.
+// A size class is used when its block size is a multiple of the alignment,
+// since blocks start at multiples of the block size within their 16 KB-aligned slab.
+static void* AllocateAligned(size_t size, size_t alignment)
+{
+    if (alignment <= s_SizeClassGranularity)
+        return Allocate(size);
+
+    size_t alignedSize = (size + alignment - 1) & ~(alignment - 1);
+    if (size <= s_MaxSmallObjectSize && alignedSize <= s_MaxSmallObjectSize && GetSizeClassBlockSize(GetSizeClass(alignedSize)) % alignment == 0)
+    {
+        if (void* ptr = AllocateSmall(GetSizeClass(alignedSize)))
+            return ptr;
+    }
+
+    if (alignment <= HugeAllocator::s_HeaderSize && s_HugeAllocator.IsHuge(size))
+        return s_HugeAllocator.alloc(size);
+    return GetThreadArena()->alloc(size, static_cast<unsigned int>(alignment));
+}
+
+// Returns ptr to whichever allocator owns its page; false if it isn't ours
+static bool FreeOwned(void* ptr)
 {
-    printf("operator new: size = %zu\n", requestedSize);
+    PageOwner owner = s_PageMap.Lookup(ptr);
+
+    // Small blocks go back through the thread cache
+    if (owner.Kind == PageOwnerKind::SizeClass && s_pAllocators[owner.Index])
+    {
+        FreeSmall(owner.Index, ptr);
+        return true;
+    }
+
+    if (owner.Kind == PageOwnerKind::HugeAllocation)
+    {
+        s_HugeAllocator.free(ptr);
+        return true;
+    }
 
-    // Attempt using our HeapManager if available
-    if (s_pHeapManager)
+    if (HeapArena* pArena = FindOwningArena(ptr, owner))
     {
-        return s_pHeapManager->alloc(requestedSize);
+        FreeToArena(pArena, ptr);
+        return true;
     }
+    return false;
+}
 
-    // Fallback to aligned malloc
-    return _aligned_malloc(requestedSize, 4);
+// Sized delete: the size names the block's class, so the page map entry only
+// has to confirm it instead of being dispatched on. Blocks from before the
+// memory system existed, or from the arena when a class was out of slabs, take
+// the general path.
+static bool FreeOwnedSized(void* ptr, size_t size)
+{
+    if (size <= s_MaxSmallObjectSize)
+    {
+        size_t sizeClass = GetSizeClass(size);
+        PageOwner owner = s_PageMap.Lookup(ptr);
+        if (owner.Kind == PageOwnerKind::SizeClass && owner.Index == sizeClass && s_pAllocators[sizeClass])
+        {
+            FreeSmall(sizeClass, ptr);
+            return true;
+        }
+    }
+    return FreeOwned(ptr);
+}
+
+// Shared by the throwing operator new forms, which must not return nullptr:
+// when the allocators are out of memory it calls the new-handler and retries
+// while one is installed, then throws std::bad_alloc. An alignment of 0 asks
+// for the default new alignment.
+static void* AllocateOrThrow(size_t size, size_t alignment)
+{
+    for (;;)
+    {
+        void* ptr;
+        if (s_NumHeapArenas > 0)
+        {
+            ptr = TraceAlloc(alignment ? AllocateAligned(size, alignment) : Allocate(size), size, alignment);
+        }
+        else
+        {
+            // Fallback to aligned malloc
+            ptr = _aligned_malloc(size, alignment ? alignment : __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+        }
+        if (ptr)
+            return ptr;
+
+        std::new_handler handler = std::get_new_handler();
+        if (!handler)
+            throw std::bad_alloc();
+        handler();
+    }
+}
+
+// Overloaded operator new
+void* operator new(size_t requestedSize)
+{
+    return AllocateOrThrow(requestedSize, 0);
 }
 
 // Overloaded operator delete
 void operator delete(void* ptr)
 {
-    printf("operator delete: ptr = 0x%" PRIXPTR "\n", reinterpret_cast<uintptr_t>(ptr));
-    if (s_pHeapManager && s_pHeapManager->IsAllocated(ptr))
+    TraceFree(ptr);
+    if (!FreeOwned(ptr))
+    {
+        _aligned_free(ptr);
+    }
+}
+
+// Overloaded sized operator delete
+void operator delete(void* ptr, size_t size)
+{
+    TraceFree(ptr);
+    if (!FreeOwnedSized(ptr, size))
     {
-        HeapManagerProxy::free(s_pHeapManager, ptr);
-        return;
+        _aligned_free(ptr);
     }
-    _aligned_free(ptr);
 }
 
 // Overloaded operator new[]
 void* operator new[](size_t requestedSize)
 {
-    printf("operator new[]: size = %zu\n", requestedSize);
-    return _aligned_malloc(requestedSize, 4);
+    return AllocateOrThrow(requestedSize, 0);
 }
 
 // Overloaded operator delete[]
 void operator delete[](void* ptr)
 {
-    printf("operator delete[]: ptr = 0x%" PRIXPTR "\n", reinterpret_cast<uintptr_t>(ptr));
+    // Return it to our allocators if one of them owns it
+    TraceFree(ptr);
+    if (!FreeOwned(ptr))
+    {
+        _aligned_free(ptr);
+    }
+}
 
-    // Check if it's allocated by one of our FixedSizeAllocators
-    for (int index = 0; index < 3; ++index)
+// Overloaded sized operator delete[]
+void operator delete[](void* ptr, size_t size)
+{
+    TraceFree(ptr);
+    if (!FreeOwnedSized(ptr, size))
     {
-        if (s_pAllocators[index] && s_pAllocators[index]->isAllocated(ptr))
-        {
-            s_pAllocators[index]->free(ptr);
-            return;
-        }
+        _aligned_free(ptr);
     }
+}
+
+// Overloaded aligned operator new, backed by HeapManager::alloc(Size, Alignment)
+void* operator new(size_t requestedSize, std::align_val_t alignment)
+{
+    return AllocateOrThrow(requestedSize, static_cast<size_t>(alignment));
+}
 
-    // Otherwise, if it belongs to the HeapManager, free it there
-    if (HeapManagerProxy::Contains(s_pHeapManager, ptr))
+void* operator new[](size_t requestedSize, std::align_val_t alignment)
+{
+    return AllocateOrThrow(requestedSize, static_cast<size_t>(alignment));
+}
+
+// Overloaded aligned operator delete. An aligned small block may sit in a
+// larger class than its size names, so these skip the sized path.
+void operator delete(void* ptr, std::align_val_t)
+{
+    TraceFree(ptr);
+    if (!FreeOwned(ptr))
     {
-        HeapManagerProxy::free(s_pHeapManager, ptr);
-        return;
+        _aligned_free(ptr);
     }
+}
 
-    _aligned_free(ptr);
+void operator delete(void* ptr, size_t, std::align_val_t alignment)
+{
+    operator delete(ptr, alignment);
 }
 
-// Replacement for malloc
-void* __cdecl malloc(size_t sizeRequest)
+void operator delete[](void* ptr, std::align_val_t)
 {
-    // Use our FixedSizeAllocators if appropriate
-    if ((sizeRequest <= 16) && s_pAllocators[0])
-        return s_pAllocators[0]->alloc();
-    if ((sizeRequest <= 32) && s_pAllocators[1])
-        return s_pAllocators[1]->alloc();
-    if ((sizeRequest <= 96) && s_pAllocators[2])
-        return s_pAllocators[2]->alloc();
+    TraceFree(ptr);
+    if (!FreeOwned(ptr))
+    {
+        _aligned_free(ptr);
+    }
+}
 
-    // Otherwise, go through the main HeapManager
-    return s_pHeapManager->alloc(sizeRequest);
+void operator delete[](void* ptr, size_t, std::align_val_t alignment)
+{
+    operator delete[](ptr, alignment);
+}
+
+MEMORY_SYSTEM_HIDDEN(malloc);
+MEMORY_SYSTEM_HIDDEN(free);
+MEMORY_SYSTEM_HIDDEN(realloc);
+MEMORY_SYSTEM_HIDDEN(calloc);
+
+// Replacement for malloc. Like operator new, it falls back to the C runtime
+// until the memory system exists.
+void* __cdecl malloc(size_t sizeRequest)
+{
+    if (s_NumHeapArenas == 0)
+        return _aligned_malloc(sizeRequest, alignof(std::max_align_t));
+    return TraceAlloc(Allocate(sizeRequest), sizeRequest);
 }
 
 // Replacement for free
 void __cdecl free(void* ptr)
 {
-    // Check if ptr came from a FixedSizeAllocator
-    for (int i = 0; i < 3; ++i)
+    // Pointers we don't own came from the C runtime fallback
+    TraceFree(ptr);
+    if (!FreeOwned(ptr))
     {
-        if (s_pAllocators[i] && s_pAllocators[i]->isAllocated(ptr))
+        _aligned_free(ptr);
+    }
+}
+
+// Resizes any block malloc returned. Blocks stay where they are when they can: a small
+// block while the new size fits its class, a huge one through mremap, and an
+// arena block by growing into its free neighbour. nullptr if there is no room.
+static void* Reallocate(void* ptr, size_t sizeRequest)
+{
+    PageOwner owner = s_PageMap.Lookup(ptr);
+    size_t oldSize;
+    if (owner.Kind == PageOwnerKind::SizeClass && s_pAllocators[owner.Index])
+    {
+        oldSize = s_pAllocators[owner.Index]->GetBlockSize();
+        if (sizeRequest <= oldSize)
+            return ptr;
+    }
+    else if (owner.Kind == PageOwnerKind::HugeAllocation)
+    {
+        if (s_HugeAllocator.IsHuge(sizeRequest))
+            return s_HugeAllocator.realloc(ptr, sizeRequest);
+        oldSize = s_HugeAllocator.GetAllocationSize(ptr);
+    }
+    else if (HeapArena* pArena = FindOwningArena(ptr, owner))
+    {
+        // Blocks growing past the huge threshold move to their own mapping
+        if (!s_HugeAllocator.IsHuge(sizeRequest))
+            return pArena->Realloc(ptr, sizeRequest);
+        oldSize = pArena->GetAllocationSize(ptr);
+    }
+    else
+    {
+        // Not ours: C runtime fallback memory stays there
+        return _aligned_realloc(ptr, sizeRequest, alignof(std::max_align_t));
+    }
+
+    // Moving to another allocator
+    void* pNew = Allocate(sizeRequest);
+    if (!pNew)
+        return nullptr;
+    memcpy(pNew, ptr, oldSize < sizeRequest ? oldSize : sizeRequest);
+    FreeOwned(ptr);
+    return pNew;
+}
+
+// Replacement for realloc; a move is traced as one realloc, not a malloc and a free
+void* __cdecl realloc(void* ptr, size_t sizeRequest)
+{
+    if (!ptr)
+        return malloc(sizeRequest);
+    if (sizeRequest == 0)
+    {
+        free(ptr);
+        return nullptr;
+    }
+    return TraceRealloc(Reallocate(ptr, sizeRequest), ptr, sizeRequest);
+}
+
+// Allocate, with the block cleared. A fresh huge mapping is already zeroed by
+// the OS, so the huge allocator only clears one it reuses from its cache;
+// anything else may be a reused block, or a page purged with MEM_RESET that
+// still holds its old contents.
+static void* AllocateZeroed(size_t size)
+{
+    if (size > s_MaxSmallObjectSize && s_HugeAllocator.IsHuge(size))
+        return s_HugeAllocator.alloc(size, true);
+
+    void* ptr = Allocate(size);
+    if (ptr)
+    {
+        memset(ptr, 0, size);
+    }
+    return ptr;
+}
+
+// Replacement for calloc
+void* __cdecl calloc(size_t count, size_t size)
+{
+    if (size != 0 && count > SIZE_MAX / size)
+        return nullptr;
+
+    size_t sizeRequest = count * size;
+    if (s_NumHeapArenas == 0)
+    {
+        void* ptr = _aligned_malloc(sizeRequest, alignof(std::max_align_t));
+        if (ptr)
         {
-            s_pAllocators[i]->free(ptr);
-            return;
+            memset(ptr, 0, sizeRequest);
         }
+        return ptr;
+    }
+    return TraceAlloc(AllocateZeroed(sizeRequest), sizeRequest);
+}
+
+// Replacement for _msize (malloc_usable_size), from the same page map lookup
+size_t __cdecl _msize(void* ptr)
+{
+    PageOwner owner = s_PageMap.Lookup(ptr);
+    if (owner.Kind == PageOwnerKind::SizeClass && s_pAllocators[owner.Index])
+    {
+        return s_pAllocators[owner.Index]->GetBlockSize();
     }
-    // If not found in an FSA, free via HeapManager
-    HeapManagerProxy::free(s_pHeapManager, ptr);
+
+    if (owner.Kind == PageOwnerKind::HugeAllocation)
+    {
+        return s_HugeAllocator.GetAllocationSize(ptr);
+    }
+
+    if (HeapArena* pArena = FindOwningArena(ptr, owner))
+    {
+        return pArena->GetAllocationSize(ptr);
+    }
+    return 0;
+}
+
+#ifndef _WIN32
+MEMORY_SYSTEM_HIDDEN(malloc_usable_size);
+
+// Replacement for malloc_usable_size, glibc's name for _msize, which would
+// otherwise read a glibc chunk header in front of our blocks
+size_t malloc_usable_size(void* ptr)
+{
+    return _msize(ptr);
 }
+#endif
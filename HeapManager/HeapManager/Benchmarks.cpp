@@ -0,0 +1,1704 @@
+#include "Benchmarks.h"
+#include "AllocatorStats.h"
+#include "BitArray.h"
+#include "ConcurrentFixedSizeAllocator.h"
+#include "FixedSizeAllocator.h"
+#include "HeapArena.h"
+#include "MemorySystem.h"
+#include "HeapManager.h"
+#include "HugeAllocator.h"
+#include "LinearAllocator.h"
+#include "MemoryResources.h"
+#include "ObjectPool.h"
+#include "PageMap.h"
+#include "SizeClasses.h"
+#include "VirtualMemory.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <list>
+#include <map>
+#include <memory_resource>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// Nearest-rank percentile of sorted samples
+static double Percentile(const vector<double>& Sorted, double Fraction)
+{
+    size_t index = static_cast<size_t>(Fraction * (Sorted.size() - 1));
+    return Sorted[index];
+}
+
+// Elapsed nanoseconds since Start
+static double ElapsedNs(chrono::steady_clock::time_point Start)
+{
+    return static_cast<double>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - Start).count());
+}
+
+void RunBenchmarks()
+{
+    RunHeapAllocScalingBenchmark();
+    RunBlockOverheadBenchmark();
+    RunEngineLatencyBenchmark();
+    RunBitArrayBenchmark();
+    RunFixedSizeAllocatorChurnBenchmark();
+    RunThreadScalingBenchmark();
+    RunConcurrentAllocatorBenchmark();
+    RunProducerConsumerBenchmark();
+    RunSlabBurstBenchmark();
+    RunSizeClassBenchmark();
+    RunGrowableHeapBenchmark();
+    RunHugeReallocBenchmark();
+    RunReallocBenchmark();
+    RunBatchBenchmark();
+    RunStatsOverheadBenchmark();
+    RunFreeSpaceStatsBenchmark();
+    RunIncrementalCollectBenchmark();
+    RunCompactionBenchmark();
+    RunLinearAllocatorBenchmark();
+    RunMemoryResourceBenchmark();
+    RunObjectPoolBenchmark();
+}
+
+// Measures alloc/free cost while the heap holds an increasing number of live blocks.
+// Every other block is released first so the free lists are fragmented.
+void RunHeapAllocScalingBenchmark()
+{
+    const size_t heapSize = 8 * 1024 * 1024;
+    const size_t liveCounts[] = { 1000, 4000, 16000, 64000 };
+    const size_t iterations = 200000;
+
+    printf("\nHeapManager alloc/free vs live block count\n");
+    printf("%12s %14s\n", "live blocks", "ns per pair");
+
+    char* pHeapMemory = new char[heapSize];
+
+    for (size_t liveCount : liveCounts)
+    {
+        HeapManager heap(pHeapMemory, heapSize, 0);
+        mt19937 rng(1234);
+        vector<void*> live;
+        live.reserve(liveCount);
+
+        for (size_t i = 0; i < liveCount; ++i)
+        {
+            live.push_back(heap.alloc(16 + rng() % 48));
+        }
+        for (size_t i = 0; i < live.size(); i += 2)
+        {
+            heap.Free(live[i]);
+            live[i] = heap.alloc(16 + rng() % 16);
+        }
+
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; ++i)
+        {
+            size_t victim = rng() % live.size();
+            heap.Free(live[victim]);
+            live[victim] = heap.alloc(16 + rng() % 48);
+        }
+        double ns = ElapsedNs(start);
+
+        printf("%12zu %14.1f\n", liveCount, ns / iterations);
+    }
+
+    delete[] pHeapMemory;
+
+    // The request's bin is full of free blocks just too small for it, with
+    // plenty of room in a bigger one: first fit must not walk the whole bin
+    printf("\nHeapManager alloc/free when the request's bin holds only smaller blocks\n");
+    printf("%12s %14s\n", "free blocks", "ns per pair");
+
+    for (size_t liveCount : liveCounts)
+    {
+        HeapManager heap(size_t(256) << 20, 64 * 1024);
+        vector<void*> tooSmall;
+        vector<void*> separators;
+        tooSmall.reserve(liveCount);
+        separators.reserve(liveCount);
+        for (size_t i = 0; i < liveCount; ++i)
+        {
+            tooSmall.push_back(heap.alloc(1040));
+            separators.push_back(heap.alloc(16));
+        }
+        void* pTail = heap.alloc(1024 * 1024);
+        heap.Free(pTail);
+        for (void* ptr : tooSmall)
+        {
+            heap.Free(ptr);
+        }
+
+        const size_t missIterations = 20000;
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < missIterations; ++i)
+        {
+            heap.Free(heap.alloc(1100));
+        }
+        double ns = ElapsedNs(start);
+
+        printf("%12zu %14.1f\n", liveCount, ns / missIterations);
+        for (void* ptr : separators)
+        {
+            heap.Free(ptr);
+        }
+    }
+}
+
+// Fills a heap with 16-byte allocations to measure the real bytes consumed per
+// allocation, then frees them in random order to measure free (and coalesce) latency.
+void RunBlockOverheadBenchmark()
+{
+    const size_t heapSize = 1024 * 1024;
+    const size_t requestSize = 16;
+
+    printf("\nHeapManager per-allocation overhead (%zu-byte requests)\n", requestSize);
+
+    char* pHeapMemory = new char[heapSize];
+    HeapManager heap(pHeapMemory, heapSize, 0);
+
+    vector<void*> live;
+    live.reserve(heapSize / requestSize);
+    while (heap.GetLargestFreeBlock() >= requestSize)
+    {
+        void* ptr = heap.alloc(requestSize);
+        if (!ptr)
+            break;
+        live.push_back(ptr);
+    }
+
+    mt19937 rng(1234);
+    shuffle(live.begin(), live.end(), rng);
+
+    auto start = chrono::steady_clock::now();
+    for (void* ptr : live)
+    {
+        heap.Free(ptr);
+    }
+    double ns = ElapsedNs(start);
+
+    printf("%14s %14s %14s\n", "allocations", "bytes/alloc", "ns per free");
+    printf("%14zu %14.1f %14.1f\n", live.size(), static_cast<double>(heapSize) / live.size(), ns / live.size());
+
+    delete[] pHeapMemory;
+}
+
+// Times every alloc call under each engine and reports the latency
+// distribution, for a mixed-size churn workload and for re-allocating one of
+// many equal-size largest free blocks. Each case runs once untimed to warm the
+// heap and then timedRuns times. The runs make the same calls in the same
+// order, so each call is reported at its fastest over the runs: a stall from
+// outside the allocator drops out, while a slow path the call takes every time
+// stays in the max.
+void RunEngineLatencyBenchmark()
+{
+    const size_t heapSize = 4 * 1024 * 1024;
+    const size_t maxLive = 4000;
+    const size_t iterations = 200000;
+    const size_t timedRuns = 5;
+    const size_t equalBlockSize = 1040;
+    const HeapEngine engines[] = { HeapEngine::SegregatedFit, HeapEngine::TLSF };
+
+    printf("\nHeapManager alloc latency by engine (ns), each call at its fastest of %zu runs\n", timedRuns);
+    printf("%20s %14s %10s %10s %10s\n", "workload", "engine", "p50", "p99", "max");
+
+    // Touch every page up front so page faults don't show up as latency
+    char* pHeapMemory = new char[heapSize];
+    memset(pHeapMemory, 0, heapSize);
+
+    // Mostly small requests with a tail of larger ones, freeing at random
+    auto mixedChurn = [&](HeapManager& heap, vector<double>& latencies)
+    {
+        mt19937 rng(1234);
+        vector<void*> live;
+        live.reserve(maxLive);
+        for (size_t i = 0; i < iterations; ++i)
+        {
+            if (live.size() >= maxLive || (!live.empty() && rng() % 2 == 0))
+            {
+                size_t victim = rng() % live.size();
+                heap.Free(live[victim]);
+                live[victim] = live.back();
+                live.pop_back();
+                continue;
+            }
+
+            size_t size = (rng() % 8 == 0) ? 256 + rng() % 2048 : 16 + rng() % 240;
+
+            auto start = chrono::steady_clock::now();
+            void* ptr = heap.alloc(size);
+            latencies.push_back(ElapsedNs(start));
+
+            if (ptr)
+            {
+                live.push_back(ptr);
+            }
+        }
+    };
+
+    // The heap is filled with equal-size blocks kept apart by small ones and
+    // the equal ones are freed, so they are all the largest free block. Each
+    // allocation takes one of them, which must not rescan the others. The
+    // request is a bin smaller than the blocks so that TLSF, which rounds it
+    // up to a bin whose blocks always fit, takes them too.
+    auto equalLargest = [&](HeapManager& heap, vector<double>& latencies)
+    {
+        vector<void*> equalBlocks;
+        while (heap.GetLargestFreeBlock() >= 2 * equalBlockSize)
+        {
+            equalBlocks.push_back(heap.alloc(equalBlockSize));
+            heap.alloc(16);
+        }
+        while (heap.GetLargestFreeBlock() >= equalBlockSize)
+        {
+            heap.alloc(256);
+        }
+        for (void* ptr : equalBlocks)
+        {
+            heap.Free(ptr);
+        }
+
+        for (size_t i = 0; i < iterations / 4; ++i)
+        {
+            auto start = chrono::steady_clock::now();
+            void* ptr = heap.alloc(equalBlockSize - 32);
+            latencies.push_back(ElapsedNs(start));
+            heap.Free(ptr);
+        }
+    };
+
+    auto report = [&](const char* workload, HeapEngine engine, auto&& run)
+    {
+        vector<double> latencies;
+        vector<double> runLatencies;
+        latencies.reserve(iterations);
+        runLatencies.reserve(iterations);
+        for (size_t i = 0; i <= timedRuns; ++i)
+        {
+            HeapManager heap(pHeapMemory, heapSize, 0, engine);
+            runLatencies.clear();
+            run(heap, runLatencies);
+            if (i == 0)
+                continue;
+
+            if (latencies.empty())
+            {
+                latencies = runLatencies;
+            }
+            for (size_t call = 0; call < latencies.size(); ++call)
+            {
+                latencies[call] = min(latencies[call], runLatencies[call]);
+            }
+        }
+
+        sort(latencies.begin(), latencies.end());
+        printf("%20s %14s %10.0f %10.0f %10.0f\n", workload, engine == HeapEngine::TLSF ? "TLSF" : "SegregatedFit",
+            Percentile(latencies, 0.50), Percentile(latencies, 0.99), latencies.back());
+    };
+
+    for (HeapEngine engine : engines)
+    {
+        report("mixed churn", engine, mixedChurn);
+    }
+    for (HeapEngine engine : engines)
+    {
+        report("equal largest", engine, equalLargest);
+    }
+
+    delete[] pHeapMemory;
+}
+
+// Finds the first clear bit in a nearly full array, where a linear scan is at
+// its worst: one random bit is cleared, found and set again per iteration
+void RunBitArrayBenchmark()
+{
+    const size_t bitCounts[] = { 1000, 100000, 10000000 };
+    const size_t iterations = 100000;
+
+    printf("\nBitArray GetFirstClearBit on a nearly full array\n");
+    printf("%12s %14s\n", "bits", "ns per find");
+
+    for (size_t bitCount : bitCounts)
+    {
+        BitArray bits(bitCount);
+        for (size_t i = 0; i < bitCount; ++i)
+        {
+            bits.SetBit(i);
+        }
+
+        mt19937 rng(1234);
+        size_t found = 0;
+
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; ++i)
+        {
+            bits.ClearBit(rng() % bitCount);
+            if (bits.GetFirstClearBit(found))
+            {
+                bits.SetBit(found);
+            }
+        }
+        double ns = ElapsedNs(start);
+
+        printf("%12zu %14.1f\n", bitCount, ns / iterations);
+    }
+}
+
+// Random alloc/free churn against one 32-byte FixedSizeAllocator, in the spirit
+// of RunMemorySystemTests, for each allocation strategy
+void RunFixedSizeAllocatorChurnBenchmark()
+{
+    const size_t blockSize = 32;
+    const size_t blockCount = 4096;
+    const size_t iterations = 2000000;
+
+    struct Config
+    {
+        const char* Name;
+        FixedSizeAllocatorMode Mode;
+        bool TrackAllocations;
+    };
+    const Config configs[] = {
+        { "Bitmap", FixedSizeAllocatorMode::Bitmap, true },
+        { "FreeList+bits", FixedSizeAllocatorMode::FreeList, true },
+        { "FreeList", FixedSizeAllocatorMode::FreeList, false },
+    };
+
+    printf("\nFixedSizeAllocator churn (%zu x %zu bytes)\n", blockCount, blockSize);
+    printf("%14s %14s\n", "mode", "Mops/sec");
+
+    // Random numbers are drawn up front so the generator isn't part of the timing
+    mt19937 rng(1234);
+    vector<uint32_t> randomValues(iterations);
+    for (uint32_t& value : randomValues)
+    {
+        value = rng();
+    }
+
+    char* pMemory = new char[blockSize * blockCount];
+
+    for (const Config& config : configs)
+    {
+        FixedSizeAllocator<> allocator(blockSize, blockCount, pMemory, config.Mode, config.TrackAllocations);
+        vector<void*> live;
+        live.reserve(blockCount);
+
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; ++i)
+        {
+            uint32_t random = randomValues[i];
+            if (!live.empty() && (live.size() == blockCount || (random & 1) == 0))
+            {
+                size_t victim = (random >> 1) % live.size();
+                allocator.free(live[victim]);
+                live[victim] = live.back();
+                live.pop_back();
+            }
+            else
+            {
+                live.push_back(allocator.alloc());
+            }
+        }
+        double ns = ElapsedNs(start);
+
+        for (void* ptr : live)
+        {
+            allocator.free(ptr);
+        }
+
+        printf("%14s %14.1f\n", config.Name, iterations * 1000.0 / ns);
+    }
+
+    delete[] pMemory;
+}
+
+// Small-object malloc/free churn through the memory system from 1 to N threads.
+// Every thread keeps a handful of live blocks and replaces one per iteration.
+void RunThreadScalingBenchmark()
+{
+    const size_t heapSize = 4 * 1024 * 1024;
+    const size_t threadCounts[] = { 1, 2, 4, 8 };
+    const size_t iterations = 1000000;
+    const size_t liveBlocks = 8;
+
+    printf("\nMemory system small-object churn by thread count (%u hardware threads)\n", thread::hardware_concurrency());
+    printf("%12s %14s\n", "threads", "Mops/sec");
+
+    char* pHeapMemory = new char[heapSize];
+    InitializeMemorySystem(pHeapMemory, heapSize, 0);
+
+    for (size_t threadCount : threadCounts)
+    {
+        auto worker = [=]()
+        {
+            void* live[liveBlocks] = {};
+            for (size_t i = 0; i < iterations; ++i)
+            {
+                size_t slot = i % liveBlocks;
+                if (live[slot])
+                {
+                    free(live[slot]);
+                }
+                live[slot] = malloc(33 + (i * 7) % 64);
+            }
+            for (void* ptr : live)
+            {
+                if (ptr)
+                {
+                    free(ptr);
+                }
+            }
+        };
+
+        vector<thread> threads;
+        threads.reserve(threadCount);
+
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < threadCount; ++i)
+        {
+            threads.emplace_back(worker);
+        }
+        for (thread& t : threads)
+        {
+            t.join();
+        }
+        double ns = ElapsedNs(start);
+
+        printf("%12zu %14.1f\n", threadCount, threadCount * iterations * 2000.0 / ns);
+    }
+
+    DestroyMemorySystem();
+    delete[] pHeapMemory;
+}
+
+// Many threads sharing one 96-byte pool: the lock-free allocator against a
+// FixedSizeAllocator behind a mutex. Each thread stamps its blocks and checks
+// the stamp before freeing, so a block handed out twice shows up as corruption.
+template<typename AllocFunc, typename FreeFunc>
+static double RunSharedPoolChurn(size_t ThreadCount, size_t Iterations, AllocFunc Alloc, FreeFunc Free, atomic<size_t>& Corruptions)
+{
+    const size_t liveBlocks = 4;
+
+    auto worker = [&](size_t threadId)
+    {
+        size_t* live[liveBlocks] = {};
+        for (size_t i = 0; i < Iterations; ++i)
+        {
+            size_t slot = i % liveBlocks;
+            if (live[slot])
+            {
+                if (*live[slot] != threadId)
+                {
+                    ++Corruptions;
+                }
+                Free(live[slot]);
+            }
+
+            live[slot] = static_cast<size_t*>(Alloc());
+            if (live[slot])
+            {
+                *live[slot] = threadId;
+            }
+        }
+        for (size_t* ptr : live)
+        {
+            if (ptr)
+            {
+                Free(ptr);
+            }
+        }
+    };
+
+    vector<thread> threads;
+    threads.reserve(ThreadCount);
+
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < ThreadCount; ++i)
+    {
+        threads.emplace_back(worker, i);
+    }
+    for (thread& t : threads)
+    {
+        t.join();
+    }
+    return ElapsedNs(start);
+}
+
+void RunConcurrentAllocatorBenchmark()
+{
+    const size_t blockSize = 96;
+    const size_t blockCount = 4096;
+    const size_t threadCounts[] = { 1, 2, 4, 8 };
+    const size_t iterations = 500000;
+
+    printf("\nShared %zu-byte pool contention (Mops/sec)\n", blockSize);
+    printf("%12s %14s %14s\n", "threads", "lock-free", "mutex");
+
+    char* pMemory = new char[blockSize * blockCount];
+    atomic<size_t> corruptions(0);
+
+    for (size_t threadCount : threadCounts)
+    {
+        ConcurrentFixedSizeAllocator lockFree(blockSize, blockCount, pMemory);
+        double lockFreeNs = RunSharedPoolChurn(threadCount, iterations,
+            [&]() { return lockFree.alloc(); },
+            [&](void* ptr) { lockFree.free(ptr); },
+            corruptions);
+
+        FixedSizeAllocator<> locked(blockSize, blockCount, pMemory, FixedSizeAllocatorMode::FreeList, false);
+        mutex lock;
+        double mutexNs = RunSharedPoolChurn(threadCount, iterations,
+            [&]() { lock_guard<mutex> guard(lock); return locked.alloc(); },
+            [&](void* ptr) { lock_guard<mutex> guard(lock); locked.free(ptr); },
+            corruptions);
+
+        double ops = threadCount * iterations * 2000.0;
+        printf("%12zu %14.1f %14.1f\n", threadCount, ops / lockFreeNs, ops / mutexNs);
+    }
+
+    printf("%12s %14zu\n", "corruptions", corruptions.load());
+
+    delete[] pMemory;
+}
+
+// Producer/consumer pairs passing medium blocks through a ring: producers
+// malloc, consumers free. With one arena every free contends on the producer's
+// lock; with an arena per thread the consumer frees go through the remote queue.
+void RunProducerConsumerBenchmark()
+{
+    const size_t heapSize = 16 * 1024 * 1024;
+    const unsigned int arenaCounts[] = { 1, 4 };
+    const size_t pairCount = 2;
+    const size_t messages = 200000;
+    const size_t ringSize = 256;
+
+    printf("\nCross-thread producer/consumer, %zu pairs, 128-2048 byte blocks\n", pairCount);
+    printf("%12s %14s\n", "arenas", "Mmsgs/sec");
+
+    struct Ring
+    {
+        void* m_Slots[ringSize] = {};
+        atomic<size_t> m_Head{ 0 };
+        atomic<size_t> m_Tail{ 0 };
+    };
+
+    char* pHeapMemory = new char[heapSize];
+
+    for (unsigned int arenaCount : arenaCounts)
+    {
+        // Allocated before the memory system comes up so they outlive it
+        vector<Ring> rings(pairCount);
+        vector<thread> threads;
+        threads.reserve(pairCount * 2);
+
+        InitializeMemorySystem(pHeapMemory, heapSize, 0, arenaCount);
+
+        auto producer = [&](Ring& ring)
+        {
+            for (size_t i = 0; i < messages; ++i)
+            {
+                void* ptr;
+                while (!(ptr = malloc(128 + (i * 37) % 1921)))
+                {
+                    this_thread::yield();
+                }
+
+                size_t tail = ring.m_Tail.load(memory_order_relaxed);
+                while (tail - ring.m_Head.load(memory_order_acquire) == ringSize)
+                {
+                    this_thread::yield();
+                }
+                ring.m_Slots[tail % ringSize] = ptr;
+                ring.m_Tail.store(tail + 1, memory_order_release);
+            }
+        };
+
+        auto consumer = [&](Ring& ring)
+        {
+            for (size_t i = 0; i < messages; ++i)
+            {
+                size_t head = ring.m_Head.load(memory_order_relaxed);
+                while (ring.m_Tail.load(memory_order_acquire) == head)
+                {
+                    this_thread::yield();
+                }
+                free(ring.m_Slots[head % ringSize]);
+                ring.m_Head.store(head + 1, memory_order_release);
+            }
+        };
+
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < pairCount; ++i)
+        {
+            threads.emplace_back(producer, ref(rings[i]));
+            threads.emplace_back(consumer, ref(rings[i]));
+        }
+        for (thread& t : threads)
+        {
+            t.join();
+        }
+        double ns = ElapsedNs(start);
+
+        printf("%12u %14.2f\n", arenaCount, pairCount * messages * 1000.0 / ns);
+
+        DestroyMemorySystem();
+    }
+
+    delete[] pHeapMemory;
+}
+
+// Bursty small-object workload: each round allocates a burst of 16-96 byte
+// blocks, then frees all of them. Reports throughput and the heap held by
+// the size class slabs at the peak and after each burst is released.
+void RunSlabBurstBenchmark()
+{
+    const size_t heapSize = 16 * 1024 * 1024;
+    const size_t burstSizes[] = { 1000, 10000, 50000 };
+    const size_t rounds = 20;
+
+    printf("\nBursty small-object workload, %zu rounds per burst size\n", rounds);
+    printf("%12s %14s %14s %14s\n", "burst", "Mops/sec", "peak KB", "after KB");
+
+    // Allocated before the memory system comes up so it outlives it
+    vector<void*> live;
+    live.reserve(burstSizes[size(burstSizes) - 1]);
+
+    char* pHeapMemory = new char[heapSize];
+    InitializeMemorySystem(pHeapMemory, heapSize, 0);
+
+    for (size_t burstSize : burstSizes)
+    {
+        size_t failures = 0;
+        auto start = chrono::steady_clock::now();
+        for (size_t round = 0; round < rounds; ++round)
+        {
+            for (size_t i = 0; i < burstSize; ++i)
+            {
+                void* ptr = malloc(8 + (i * 13) % 89);
+                if (ptr)
+                {
+                    live.push_back(ptr);
+                }
+                else
+                {
+                    ++failures;
+                }
+            }
+            for (void* ptr : live)
+            {
+                free(ptr);
+            }
+            live.clear();
+        }
+        double ns = ElapsedNs(start);
+
+        FlushThreadCache();
+        printf("%12zu %14.1f %14zu %14zu", burstSize, rounds * burstSize * 2000.0 / ns,
+            GetPeakSmallObjectBytes() / 1024, GetSmallObjectBytes() / 1024);
+        if (failures)
+        {
+            printf("   (%zu failed)", failures);
+        }
+        printf("\n");
+    }
+
+    DestroyMemorySystem();
+    delete[] pHeapMemory;
+}
+
+// Size class table: internal fragmentation against the old 16/32/96 pools,
+// class lookup cost against a linear scan of the same 40 classes, and the
+// block-index computation in isAllocated with a runtime vs compile-time block size
+void RunSizeClassBenchmark()
+{
+    const size_t lookups = 10000000;
+    const size_t blockCount = 4096;
+
+    printf("\nSmall-object size classes (%zu classes up to %zu bytes), old pools vs classes\n", s_NumSizeClasses, s_MaxSmallObjectSize);
+
+    // Old scheme: three pools, anything larger went to the HeapManager with an
+    // 8-byte header and 8-byte rounding
+    const size_t ranges[][2] = { { 1, 96 }, { 97, s_MaxSmallObjectSize } };
+    for (const auto& range : ranges)
+    {
+        double requested = 0.0;
+        double wasteOld = 0.0;
+        double wasteNew = 0.0;
+        for (size_t size = range[0]; size <= range[1]; ++size)
+        {
+            size_t oldSize = size <= 16 ? 16 : size <= 32 ? 32 : size <= 96 ? 96 : ((size + 7) & ~size_t(7)) + sizeof(MemoryBlock);
+            requested += size;
+            wasteOld += oldSize - size;
+            wasteNew += GetSizeClassBlockSize(GetSizeClass(size)) - size;
+        }
+        printf("%12s %4zu-%-4zu %9.1f%% %9.1f%%\n", "waste", range[0], range[1], wasteOld * 100.0 / requested, wasteNew * 100.0 / requested);
+    }
+
+    mt19937 rng(1234);
+    vector<uint16_t> sizes(4096);
+    for (uint16_t& size : sizes)
+    {
+        size = static_cast<uint16_t>(1 + rng() % s_MaxSmallObjectSize);
+    }
+
+    size_t checksum = 0;
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < lookups; ++i)
+    {
+        checksum += GetSizeClass(sizes[i & 4095]);
+    }
+    double tableNs = ElapsedNs(start) / lookups;
+
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < lookups; ++i)
+    {
+        size_t sizeClass = 0;
+        while (GetSizeClassBlockSize(sizeClass) < sizes[i & 4095])
+        {
+            ++sizeClass;
+        }
+        checksum += sizeClass;
+    }
+    double scanNs = ElapsedNs(start) / lookups;
+    printf("%22s %9.2fns %9.2fns   (checksum %zu)\n", "lookup table / scan", tableNs, scanNs, checksum);
+
+    // isAllocated with tracking on finds the block index on every call: a
+    // multiply by the reciprocal for <>, by a constant for <96>
+    const size_t blockSize = 96;
+    char* pMemory = new char[blockSize * blockCount];
+    FixedSizeAllocator<> runtimeSized(blockSize, blockCount, pMemory, FixedSizeAllocatorMode::FreeList, true);
+    FixedSizeAllocator<blockSize> compileTimeSized(blockCount, pMemory, FixedSizeAllocatorMode::FreeList, true);
+    for (size_t i = 0; i < blockCount / 2; ++i)
+    {
+        runtimeSized.alloc();
+        compileTimeSized.alloc();
+    }
+
+    size_t hits = 0;
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < lookups; ++i)
+    {
+        hits += runtimeSized.isAllocated(pMemory + sizes[i & 4095] * 383 % (blockSize * blockCount));
+    }
+    double runtimeNs = ElapsedNs(start) / lookups;
+
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < lookups; ++i)
+    {
+        hits += compileTimeSized.isAllocated(pMemory + sizes[i & 4095] * 383 % (blockSize * blockCount));
+    }
+    double compileTimeNs = ElapsedNs(start) / lookups;
+    printf("%22s %9.2fns %9.2fns   (hits %zu)\n", "isAllocated <> / <96>", runtimeNs, compileTimeNs, hits);
+
+    delete[] pMemory;
+}
+
+// OS-backed HeapManager: grows from 256 KB while a working set of 256-8192
+// byte blocks is built, then frees 90% of it. Resident memory is sampled at
+// the peak and after each Collect; free pages idle for two collections are purged.
+void RunGrowableHeapBenchmark()
+{
+    const size_t reserveSize = size_t(1) << 30;
+    const size_t blockCount = 40000;
+    const size_t collects = 4;
+
+    printf("\nOS-backed growable heap (%zu MB reserved)\n", reserveSize >> 20);
+    printf("%24s %14s %14s\n", "", "committed KB", "resident KB");
+
+    vector<void*> blocks;
+    blocks.reserve(blockCount);
+    size_t residentBefore = GetResidentMemoryBytes();
+
+    HeapManager heap(reserveSize, 256 * 1024);
+    mt19937 rng(1234);
+
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < blockCount; ++i)
+    {
+        size_t size = 256 + rng() % (8192 - 256);
+        void* ptr = heap.alloc(size);
+        if (!ptr)
+            break;
+        memset(ptr, 0xAB, size);
+        blocks.push_back(ptr);
+    }
+    double allocNs = ElapsedNs(start);
+
+    auto report = [&](const char* label)
+    {
+        size_t resident = GetResidentMemoryBytes();
+        printf("%24s %14zu %14zu\n", label, heap.GetCommittedSize() / 1024,
+            resident > residentBefore ? (resident - residentBefore) / 1024 : 0);
+    };
+    report("peak");
+
+    // Keep every tenth block so the free space is split up as well
+    for (size_t i = 0; i < blocks.size(); ++i)
+    {
+        if (i % 10 != 0)
+        {
+            heap.Free(blocks[i]);
+        }
+    }
+    report("after free");
+
+    char label[32];
+    for (size_t i = 1; i <= collects; ++i)
+    {
+        heap.Collect();
+        snprintf(label, sizeof(label), "after Collect %zu", i);
+        report(label);
+    }
+
+    printf("%24s %14.1f ns/alloc including growth\n", "", allocNs / blocks.size());
+}
+
+// Doubles a huge buffer from 1 MB to 1 GB, resizing it with mremap against
+// the usual allocate + memcpy + free. Both fill the new half after each step,
+// only the resize itself is timed.
+void RunHugeReallocBenchmark()
+{
+    const size_t startSize = size_t(1) << 20;
+    const size_t endSize = size_t(1) << 30;
+
+    printf("\nHuge allocation growth, %zu MB to %zu MB\n", startSize >> 20, endSize >> 20);
+    printf("%10s %14s %14s\n", "size MB", "remap us", "memcpy us");
+
+    PageMap pageMap;
+    mutex pageMapMutex;
+    HugeAllocator huge(pageMap, pageMapMutex);
+
+    void* pRemapped = huge.alloc(startSize);
+    void* pCopied = huge.alloc(startSize);
+    if (!pRemapped || !pCopied)
+    {
+        printf("Error: unable to map the initial buffers\n");
+        return;
+    }
+    memset(pRemapped, 0xAB, startSize);
+    memset(pCopied, 0xAB, startSize);
+
+    double totalRemapNs = 0;
+    double totalCopyNs = 0;
+    for (size_t size = startSize * 2; size <= endSize; size *= 2)
+    {
+        auto start = chrono::steady_clock::now();
+        void* pGrown = huge.realloc(pRemapped, size);
+        double remapNs = ElapsedNs(start);
+        if (!pGrown)
+            break;
+        pRemapped = pGrown;
+        memset(static_cast<char*>(pRemapped) + size / 2, 0xAB, size / 2);
+
+        start = chrono::steady_clock::now();
+        pGrown = huge.alloc(size);
+        if (pGrown)
+        {
+            memcpy(pGrown, pCopied, size / 2);
+            huge.free(pCopied);
+        }
+        double copyNs = ElapsedNs(start);
+        if (!pGrown)
+            break;
+        pCopied = pGrown;
+        memset(static_cast<char*>(pCopied) + size / 2, 0xAB, size / 2);
+
+        totalRemapNs += remapNs;
+        totalCopyNs += copyNs;
+        printf("%10zu %14.1f %14.1f\n", size >> 20, remapNs / 1000, copyNs / 1000);
+    }
+    printf("%10s %14.1f %14.1f\n", "total", totalRemapNs / 1000, totalCopyNs / 1000);
+
+    huge.free(pRemapped);
+    huge.free(pCopied);
+}
+
+// Grows a set of interleaved vectors by 1.5x at a time with
+// HeapManager::Realloc against alloc + memcpy + Free, counting the bytes each
+// copies. Realloc only copies when the neighbouring block is taken.
+void RunReallocBenchmark()
+{
+    const size_t vectorCount = 16;
+    const size_t startSize = 16;
+    const size_t endSize = 256 * 1024;
+
+    printf("\nVector growth, %zu vectors from %zu bytes to %zu KB\n", vectorCount, startSize, endSize / 1024);
+    printf("%16s %14s %14s %14s %12s\n", "", "ms", "KB copied", "KB avoided", "in place");
+
+    for (int useRealloc = 0; useRealloc < 2; ++useRealloc)
+    {
+        HeapManager heap(size_t(256) << 20, 256 * 1024);
+        void* vectors[vectorCount];
+        size_t sizes[vectorCount];
+        for (size_t i = 0; i < vectorCount; ++i)
+        {
+            sizes[i] = startSize;
+            vectors[i] = heap.alloc(startSize);
+        }
+
+        size_t bytesCopied = 0;
+        size_t bytesAvoided = 0;
+        size_t resizes = 0;
+        size_t inPlace = 0;
+        mt19937 rng(1234);
+
+        auto start = chrono::steady_clock::now();
+        bool growing = true;
+        while (growing)
+        {
+            growing = false;
+            for (size_t i = 0; i < vectorCount; ++i)
+            {
+                if (sizes[i] >= endSize)
+                    continue;
+
+                // Vectors grow at different rates so their neighbours change
+                growing = true;
+                if (rng() % 4 == 0)
+                    continue;
+
+                size_t newSize = sizes[i] + sizes[i] / 2;
+                void* pGrown;
+                if (useRealloc)
+                {
+                    pGrown = heap.Realloc(vectors[i], newSize);
+                    if (pGrown == vectors[i])
+                    {
+                        ++inPlace;
+                        bytesAvoided += sizes[i];
+                    }
+                    else
+                    {
+                        bytesCopied += sizes[i];
+                    }
+                }
+                else
+                {
+                    pGrown = heap.alloc(newSize);
+                    memcpy(pGrown, vectors[i], sizes[i]);
+                    heap.Free(vectors[i]);
+                    bytesCopied += sizes[i];
+                }
+                vectors[i] = pGrown;
+                sizes[i] = newSize;
+                ++resizes;
+            }
+        }
+        double ns = ElapsedNs(start);
+
+        printf("%16s %14.2f %14zu %14zu %11.1f%%\n", useRealloc ? "Realloc" : "alloc+memcpy", ns / 1e6, bytesCopied / 1024,
+            bytesAvoided / 1024, 100.0 * inPlace / resizes);
+
+        for (size_t i = 0; i < vectorCount; ++i)
+        {
+            heap.Free(vectors[i]);
+        }
+    }
+}
+
+// Allocates and frees groups of 64-1024 objects one call at a time against
+// AllocBatch/FreeBatch. The HeapArena rows include its lock, which the batch
+// takes once instead of once per object.
+void RunBatchBenchmark()
+{
+    const size_t blockSize = 64;
+    const size_t blockCount = 4096;
+    const size_t batchSizes[] = { 64, 256, 1024 };
+    const size_t objectsPerRun = 4000000;
+
+    printf("\nBatch alloc/free of %zu-byte objects\n", blockSize);
+    printf("%14s %8s %14s %14s %10s\n", "allocator", "batch", "single ns/obj", "batch ns/obj", "speedup");
+
+    const size_t heapSize = 4 * blockCount * (blockSize + 16);
+    char* pMemory = new char[heapSize];
+    vector<void*> blocks(blockCount);
+
+    // Runs alloc + free of batchSize objects until objectsPerRun have gone through
+    auto timeRounds = [&](size_t batchSize, auto&& round)
+    {
+        auto start = chrono::steady_clock::now();
+        for (size_t done = 0; done < objectsPerRun; done += batchSize)
+        {
+            round(batchSize);
+        }
+        return ElapsedNs(start) / objectsPerRun;
+    };
+
+    for (size_t batchSize : batchSizes)
+    {
+        for (int useFreeList = 0; useFreeList < 2; ++useFreeList)
+        {
+            FixedSizeAllocator<blockSize> allocator(blockCount, pMemory,
+                useFreeList ? FixedSizeAllocatorMode::FreeList : FixedSizeAllocatorMode::Bitmap);
+            double singleNs = timeRounds(batchSize, [&](size_t count)
+            {
+                for (size_t i = 0; i < count; ++i)
+                {
+                    blocks[i] = allocator.alloc();
+                }
+                for (size_t i = 0; i < count; ++i)
+                {
+                    allocator.free(blocks[i]);
+                }
+            });
+            double batchNs = timeRounds(batchSize, [&](size_t count)
+            {
+                allocator.AllocBatch(count, blocks.data());
+                allocator.FreeBatch(blocks.data(), count);
+            });
+            printf("%14s %8zu %14.1f %14.1f %9.1fx\n", useFreeList ? "FSA FreeList" : "FSA Bitmap", batchSize,
+                singleNs, batchNs, singleNs / batchNs);
+        }
+
+        {
+            HeapManager heap(pMemory, heapSize, 0);
+            double singleNs = timeRounds(batchSize, [&](size_t count)
+            {
+                for (size_t i = 0; i < count; ++i)
+                {
+                    blocks[i] = heap.alloc(blockSize);
+                }
+                for (size_t i = 0; i < count; ++i)
+                {
+                    heap.Free(blocks[i]);
+                }
+            });
+            double batchNs = timeRounds(batchSize, [&](size_t count)
+            {
+                heap.AllocBatch(blockSize, count, blocks.data());
+                heap.FreeBatch(blocks.data(), count);
+            });
+            printf("%14s %8zu %14.1f %14.1f %9.1fx\n", "HeapManager", batchSize, singleNs, batchNs, singleNs / batchNs);
+        }
+
+        {
+            HeapArena arena(pMemory, heapSize, 0);
+            double singleNs = timeRounds(batchSize, [&](size_t count)
+            {
+                for (size_t i = 0; i < count; ++i)
+                {
+                    blocks[i] = arena.alloc(blockSize);
+                }
+                for (size_t i = 0; i < count; ++i)
+                {
+                    arena.free(blocks[i]);
+                }
+            });
+            double batchNs = timeRounds(batchSize, [&](size_t count)
+            {
+                arena.AllocBatch(blockSize, count, blocks.data());
+                arena.FreeBatch(blocks.data(), count);
+            });
+            printf("%14s %8zu %14.1f %14.1f %9.1fx\n", "HeapArena", batchSize, singleNs, batchNs, singleNs / batchNs);
+        }
+    }
+
+    delete[] pMemory;
+}
+
+// Cost of the per-thread size-class counters on the malloc/free fast path,
+// next to the cost of the pair itself, and of reading a GetStats() snapshot
+void RunStatsOverheadBenchmark()
+{
+    const size_t iterations = 20000000;
+    const size_t snapshots = 1000;
+
+    printf("\nAllocator statistics overhead\n");
+
+    ThreadStats counters;
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i)
+    {
+        counters.CountAlloc(i & 31);
+        counters.CountFree(i & 31);
+    }
+    double counterNs = ElapsedNs(start) / iterations;
+
+    InitializeMemorySystem(size_t(64) << 20);
+
+    start = chrono::steady_clock::now();
+    void* volatile pBlock = nullptr;
+    for (size_t i = 0; i < iterations; ++i)
+    {
+        pBlock = malloc(16 + (i & 255));
+        free(pBlock);
+    }
+    double pairNs = ElapsedNs(start) / iterations;
+
+    start = chrono::steady_clock::now();
+    size_t bytesInUse = 0;
+    for (size_t i = 0; i < snapshots; ++i)
+    {
+        bytesInUse += GetStats().BytesInUse;
+    }
+    double snapshotNs = ElapsedNs(start) / snapshots;
+
+    printf("%36s %10.2f ns\n", "counters per malloc/free pair", counterNs);
+    printf("%36s %10.2f ns\n", "small malloc/free pair", pairNs);
+    printf("%36s %10.2f us\n", "GetStats snapshot", snapshotNs / 1000);
+    DumpStatsJson(GetStats(), stdout);
+
+    DestroyMemorySystem();
+}
+
+// Mixed-size churn on a HeapArena, alone and while another thread polls its
+// free space counters without the lock: every 100 us, as a monitor deciding
+// when to Collect would, and in a tight loop that keeps their cache lines moving
+void RunFreeSpaceStatsBenchmark()
+{
+    const size_t operations = 4000000;
+    const size_t liveSlots = 8192;
+    const char* monitors[] = { "none", "every 100 us", "tight loop" };
+
+    printf("\nFree space counters polled during HeapArena churn\n");
+    printf("%14s %12s %10s %10s %8s\n", "monitor", "churn ns/op", "polls", "ns/poll", "frag");
+
+    for (int monitor = 0; monitor < 3; ++monitor)
+    {
+        HeapArena arena(size_t(256) << 20, size_t(1) << 20);
+        vector<void*> live(liveSlots, nullptr);
+        mt19937 rng(1234);
+
+        atomic<bool> done(false);
+        size_t polls = 0;
+        double pollNs = 0;
+        thread monitorThread;
+        if (monitor)
+        {
+            monitorThread = thread([&]()
+            {
+                double fragmentation = 0;
+                while (!done.load(memory_order_relaxed))
+                {
+                    auto start = chrono::steady_clock::now();
+                    fragmentation += arena.GetFreeSpaceStats().GetExternalFragmentation();
+                    pollNs += ElapsedNs(start);
+                    ++polls;
+                    if (monitor == 1)
+                    {
+                        this_thread::sleep_for(chrono::microseconds(100));
+                    }
+                }
+                pollNs /= max<size_t>(polls, 1);
+            });
+        }
+
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < operations; ++i)
+        {
+            void*& slot = live[rng() % liveSlots];
+            if (slot)
+            {
+                arena.free(slot);
+            }
+            slot = arena.alloc(16 + rng() % 4096);
+        }
+        double churnNs = ElapsedNs(start) / operations;
+
+        done.store(true, memory_order_relaxed);
+        if (monitorThread.joinable())
+        {
+            monitorThread.join();
+        }
+        printf("%14s %12.1f %10zu %10.1f %8.3f\n", monitors[monitor], churnNs, polls, pollNs,
+            arena.GetFreeSpaceStats().GetExternalFragmentation());
+
+        for (void* ptr : live)
+        {
+            arena.free(ptr);
+        }
+    }
+}
+
+// Longest single Collect pause over a heap of many small blocks, with a whole
+// pass per call and with budgeted calls, after freeing half the blocks with
+// coalescing deferred; then random churn with immediate and deferred coalescing
+void RunIncrementalCollectBenchmark()
+{
+    const size_t blockCount = 400000;
+    const size_t blockSize = 48;
+    const size_t budgets[] = { 0, 4096, 256 };
+    const size_t churnOperations = 4000000;
+
+    printf("\nCollect pauses over %zu blocks of %zu bytes, half freed unmerged\n", blockCount, blockSize);
+    printf("%10s %8s %14s %14s %14s\n", "budget", "calls", "max pause us", "total ms", "free blocks");
+
+    vector<void*> blocks(blockCount);
+    for (size_t budget : budgets)
+    {
+        HeapManager heap(size_t(256) << 20, size_t(1) << 20);
+        heap.SetDeferredCoalescing(true);
+        for (void*& ptr : blocks)
+        {
+            ptr = heap.alloc(blockSize);
+        }
+        mt19937 rng(1234);
+        for (void*& ptr : blocks)
+        {
+            if (rng() & 1)
+            {
+                heap.Free(ptr);
+                ptr = nullptr;
+            }
+        }
+
+        size_t calls = 0;
+        double maxPauseNs = 0;
+        double totalNs = 0;
+        bool passDone = false;
+        while (!passDone)
+        {
+            auto start = chrono::steady_clock::now();
+            if (budget == 0)
+            {
+                heap.Collect();
+                passDone = true;
+            }
+            else
+            {
+                passDone = heap.Collect(budget);
+            }
+            double pauseNs = ElapsedNs(start);
+            maxPauseNs = max(maxPauseNs, pauseNs);
+            totalNs += pauseNs;
+            ++calls;
+        }
+        char label[32];
+        snprintf(label, sizeof(label), budget ? "%zu" : "whole heap", budget);
+        printf("%10s %8zu %14.1f %14.2f %14zu\n", label, calls,
+            maxPauseNs / 1000, totalNs / 1000000, heap.GetFreeSpaceStats().FreeBlockCount);
+
+        for (void* ptr : blocks)
+        {
+            heap.Free(ptr);
+        }
+    }
+
+    // Deferred coalescing pays off when freed blocks are reused as they are,
+    // and costs more when sizes vary and fits fail
+    const size_t liveSlots = 16384;
+    const size_t sizeRanges[] = { 1, 2033 };
+    printf("\nChurn by coalescing mode\n");
+    printf("%12s %10s %10s %14s %8s\n", "sizes", "mode", "ns/op", "committed KB", "frag");
+    for (size_t sizeRange : sizeRanges)
+    {
+        for (int defer = 0; defer < 2; ++defer)
+        {
+            HeapManager heap(size_t(256) << 20, size_t(1) << 20);
+            heap.SetDeferredCoalescing(defer != 0);
+            vector<void*> live(liveSlots, nullptr);
+            mt19937 rng(1234);
+
+            auto start = chrono::steady_clock::now();
+            for (size_t i = 0; i < churnOperations; ++i)
+            {
+                void*& slot = live[rng() % liveSlots];
+                heap.Free(slot);
+                slot = heap.alloc(16 + rng() % sizeRange);
+            }
+            double churnNs = ElapsedNs(start) / churnOperations;
+
+            char label[32];
+            snprintf(label, sizeof(label), "16-%zu", 15 + sizeRange);
+            printf("%12s %10s %10.1f %14zu %8.3f\n", label, defer ? "deferred" : "immediate", churnNs,
+                heap.GetCommittedSize() / 1024, heap.GetFreeSpaceStats().GetExternalFragmentation());
+        }
+    }
+}
+
+// Fragments a fixed heap of relocatable blocks, with about one in a thousand
+// pinned and as many ordinary blocks that can't move, by freeing half of them
+// at random; then compacts it a budget at a time and checks every surviving
+// block's contents. The free space left between the blocks that can't move
+// bounds how far the largest free block recovers.
+void RunCompactionBenchmark()
+{
+    const size_t heapSize = 16 * 1024 * 1024;
+    const size_t compactBudget = 1024;
+
+    printf("\nCompaction of a fragmented %zu MB heap of relocatable blocks\n", heapSize >> 20);
+
+    char* pMemory = new char[heapSize];
+    HeapManager heap(pMemory, heapSize, 0);
+
+    struct Allocation {
+        HeapHandle Handle;
+        void* ptr;      // ordinary blocks only
+        size_t Size;
+    };
+    vector<Allocation> allocations;
+    mt19937 rng(1234);
+
+    // Each block is filled with a byte derived from its position in the list
+    while (heap.GetFreeSpaceStats().FreeBytes > heapSize / 8)
+    {
+        size_t size = 32 + rng() % 2048;
+        unsigned char fill = static_cast<unsigned char>(allocations.size());
+        Allocation allocation = { s_InvalidHeapHandle, nullptr, size };
+        if (rng() % 1024 == 0)
+        {
+            allocation.ptr = heap.alloc(size);
+            memset(allocation.ptr, fill, size);
+        }
+        else
+        {
+            allocation.Handle = heap.AllocRelocatable(size);
+            memset(heap.Pin(allocation.Handle), fill, size);
+            if (rng() % 1024 != 0)
+            {
+                heap.Unpin(allocation.Handle);
+            }
+        }
+        allocations.push_back(allocation);
+    }
+
+    for (Allocation& allocation : allocations)
+    {
+        if (allocation.Handle != s_InvalidHeapHandle && rng() % 2 == 0)
+        {
+            heap.FreeRelocatable(allocation.Handle);
+            allocation.Handle = s_InvalidHeapHandle;
+            allocation.Size = 0;
+        }
+    }
+
+    printf("%16s %12s %12s %12s %8s\n", "", "free KB", "free blocks", "largest KB", "frag");
+    auto printFreeSpace = [&](const char* label)
+    {
+        FreeSpaceStats stats = heap.GetFreeSpaceStats();
+        printf("%16s %12zu %12zu %12zu %8.3f\n", label, stats.FreeBytes / 1024, stats.FreeBlockCount,
+            heap.GetLargestFreeBlock() / 1024, stats.GetExternalFragmentation());
+    };
+    printFreeSpace("fragmented");
+
+    size_t calls = 0;
+    double maxPauseNs = 0;
+    double totalNs = 0;
+    bool passDone = false;
+    while (!passDone)
+    {
+        auto start = chrono::steady_clock::now();
+        passDone = heap.Compact(compactBudget);
+        double pauseNs = ElapsedNs(start);
+        maxPauseNs = max(maxPauseNs, pauseNs);
+        totalNs += pauseNs;
+        ++calls;
+    }
+    printFreeSpace("compacted");
+
+    size_t corruptions = 0;
+    for (size_t i = 0; i < allocations.size(); ++i)
+    {
+        Allocation& allocation = allocations[i];
+        if (allocation.Size == 0)
+            continue;
+
+        unsigned char* pBytes = static_cast<unsigned char*>(allocation.ptr ? allocation.ptr : heap.Pin(allocation.Handle));
+        for (size_t j = 0; j < allocation.Size; ++j)
+        {
+            corruptions += pBytes[j] != static_cast<unsigned char>(i);
+        }
+        if (!allocation.ptr)
+        {
+            heap.Unpin(allocation.Handle);
+        }
+    }
+    printf("%zu Compact calls of %zu blocks, max pause %.1f us, total %.2f ms, %zu corrupted bytes\n",
+        calls, compactBudget, maxPauseNs / 1000, totalNs / 1000000, corruptions);
+
+    delete[] pMemory;
+}
+
+// Per-frame scratch objects freed one by one to the heap, against a linear
+// allocator reset each frame, rewound to a marker taken after long-lived data,
+// and double buffered so each frame's objects survive into the next
+void RunLinearAllocatorBenchmark()
+{
+    const size_t heapSize = 64 * 1024 * 1024;
+    const size_t frames = 200;
+    const size_t objectsPerFrame = 10000;
+    const char* modes[] = { "heap alloc/free", "linear reset", "linear marker", "double buffered" };
+
+    printf("\nPer-frame scratch allocation, %zu frames of %zu objects of 16-256 bytes\n", frames, objectsPerFrame);
+    printf("%16s %10s %12s %14s %10s\n", "", "ns/alloc", "ns/release", "heap calls", "chunk KB");
+
+    vector<size_t> sizes(objectsPerFrame);
+    mt19937 rng(1234);
+    for (size_t& size : sizes)
+    {
+        size = 16 + rng() % 241;
+    }
+
+    for (int mode = 0; mode < 4; ++mode)
+    {
+        char* pMemory = new char[heapSize];
+        HeapManager heap(pMemory, heapSize, 0);
+        LinearAllocator linear(heap);
+        DoubleBufferedAllocator doubleBuffered(heap);
+        vector<void*> objects(objectsPerFrame);
+
+        // Long-lived data at the bottom of the arena that the marker keeps
+        linear.alloc(4096);
+        LinearAllocator::Marker frameStart = linear.GetMarker();
+
+        uint64_t heapAllocsBefore = heap.GetStats().AllocCount;
+        double allocNs = 0;
+        double releaseNs = 0;
+        for (size_t frame = 0; frame < frames; ++frame)
+        {
+            auto start = chrono::steady_clock::now();
+            for (size_t i = 0; i < objectsPerFrame; ++i)
+            {
+                switch (mode)
+                {
+                case 0: objects[i] = heap.alloc(sizes[i]); break;
+                case 1:
+                case 2: objects[i] = linear.alloc(sizes[i]); break;
+                default: objects[i] = doubleBuffered.alloc(sizes[i]); break;
+                }
+                static_cast<char*>(objects[i])[0] = static_cast<char>(i);
+            }
+            allocNs += ElapsedNs(start);
+
+            start = chrono::steady_clock::now();
+            switch (mode)
+            {
+            case 0:
+                for (void* ptr : objects)
+                {
+                    heap.Free(ptr);
+                }
+                break;
+            case 1: linear.Reset(); break;
+            case 2: linear.FreeToMarker(frameStart); break;
+            default: doubleBuffered.SwapBuffers(); break;
+            }
+            releaseNs += ElapsedNs(start);
+        }
+
+        size_t chunkBytes = linear.GetChunkBytes() + doubleBuffered.GetCurrentBuffer().GetChunkBytes() +
+            doubleBuffered.GetPreviousBuffer().GetChunkBytes();
+        printf("%16s %10.1f %12.1f %14" PRIu64 " %10zu\n", modes[mode], allocNs / (frames * objectsPerFrame),
+            releaseNs / frames, heap.GetStats().AllocCount - heapAllocsBefore, chunkBytes / 1024);
+
+        linear.Release();
+        doubleBuffered.Release();
+        delete[] pMemory;
+    }
+}
+
+// pmr::vector growth and pmr::unordered_map insert/find/erase on the default
+// resource (operator new, the C runtime heap here) and on the adapters over a
+// HeapManager of their own
+void RunMemoryResourceBenchmark()
+{
+    const size_t heapSize = 256 * 1024 * 1024;
+    const size_t vectorCount = 2000;
+    const size_t vectorLength = 1000;
+    const size_t mapSize = 200000;
+    const char* resources[] = { "default", "HeapManager", "FixedSizePool", "LinearAllocator" };
+
+    printf("\nstd::pmr containers, %zu vectors of %zu ints and a map of %zu ints\n", vectorCount, vectorLength, mapSize);
+    printf("%16s %14s %14s %14s %14s\n", "resource", "vector ns/push", "map ns/insert", "map ns/find", "map ns/erase");
+
+    vector<int> keys(mapSize);
+    mt19937 rng(1234);
+    for (int& key : keys)
+    {
+        key = static_cast<int>(rng());
+    }
+
+    for (int resourceIndex = 0; resourceIndex < 4; ++resourceIndex)
+    {
+        char* pMemory = new char[heapSize];
+        HeapManager heap(pMemory, heapSize, 0);
+        HeapManagerResource heapResource(heap);
+        FixedSizePoolResource poolResource(heap);
+        LinearAllocator linear(heap, 1024 * 1024);
+        LinearAllocatorResource linearResource(linear);
+        pmr::memory_resource* pResources[] = { pmr::get_default_resource(), &heapResource, &poolResource, &linearResource };
+        pmr::memory_resource* pResource = pResources[resourceIndex];
+
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < vectorCount; ++i)
+        {
+            pmr::vector<int> values(pResource);
+            for (size_t j = 0; j < vectorLength; ++j)
+            {
+                values.push_back(static_cast<int>(j));
+            }
+        }
+        double pushNs = ElapsedNs(start) / (vectorCount * vectorLength);
+        linear.Reset();
+
+        size_t found = 0;
+        double insertNs, findNs, eraseNs;
+        {
+            pmr::unordered_map<int, int> map(pResource);
+            start = chrono::steady_clock::now();
+            for (int key : keys)
+            {
+                map.emplace(key, key);
+            }
+            insertNs = ElapsedNs(start) / mapSize;
+
+            start = chrono::steady_clock::now();
+            for (size_t i = 0; i < mapSize; ++i)
+            {
+                found += map.count(keys[(i * 7919) % mapSize]);
+            }
+            findNs = ElapsedNs(start) / mapSize;
+
+            start = chrono::steady_clock::now();
+            for (int key : keys)
+            {
+                map.erase(key);
+            }
+            eraseNs = ElapsedNs(start) / mapSize;
+        }
+
+        printf("%16s %14.1f %14.1f %14.1f %14.1f%s\n", resources[resourceIndex], pushNs, insertNs, findNs, eraseNs,
+            found == mapSize ? "" : "  (lookup mismatch)");
+
+        poolResource.Release();
+        linear.Release();
+        delete[] pMemory;
+    }
+}
+
+// Messages built and torn down through an ObjectPool (one destroy per object
+// in random order, or a single destroy_all) and through new/delete, then
+// std::list and std::map nodes from ObjectPoolAllocator and std::allocator
+void RunObjectPoolBenchmark()
+{
+    struct Message {
+        uint64_t Id;
+        uint32_t Type;
+        uint32_t Length;
+        char Payload[48];
+
+        Message(uint64_t i_Id, uint32_t i_Type) : Id(i_Id), Type(i_Type), Length(0) { Payload[0] = 0; }
+    };
+    const size_t objectCount = 200000;
+    const size_t rounds = 20;
+
+    printf("\nObjectPool<Message> of %zu %zu-byte messages, %zu rounds\n", objectCount, sizeof(Message), rounds);
+    printf("%28s %12s %14s\n", "", "ns/create", "ns/teardown");
+
+    vector<size_t> order(objectCount);
+    for (size_t i = 0; i < objectCount; ++i)
+    {
+        order[i] = i;
+    }
+    shuffle(order.begin(), order.end(), mt19937(1234));
+
+    char* pMemory = new char[objectCount * ObjectPool<Message>::s_BlockSize];
+    vector<Message*> messages(objectCount);
+    for (int mode = 0; mode < 3; ++mode)
+    {
+        ObjectPool<Message> pool(objectCount, pMemory);
+        double createNs = 0;
+        double teardownNs = 0;
+        for (size_t round = 0; round < rounds; ++round)
+        {
+            auto start = chrono::steady_clock::now();
+            for (size_t i = 0; i < objectCount; ++i)
+            {
+                messages[i] = mode == 0 ? new Message(i, 1) : pool.construct(i, 1);
+            }
+            createNs += ElapsedNs(start);
+
+            start = chrono::steady_clock::now();
+            if (mode == 2)
+            {
+                pool.destroy_all();
+            }
+            else
+            {
+                for (size_t index : order)
+                {
+                    if (mode == 0)
+                    {
+                        delete messages[index];
+                    }
+                    else
+                    {
+                        pool.destroy(messages[index]);
+                    }
+                }
+            }
+            teardownNs += ElapsedNs(start);
+        }
+
+        const char* modes[] = { "new/delete", "construct/destroy", "construct/destroy_all" };
+        printf("%28s %12.1f %14.1f\n", modes[mode], createNs / (rounds * objectCount), teardownNs / (rounds * objectCount));
+    }
+    delete[] pMemory;
+
+    const size_t nodeCount = 100000;
+    printf("%28s %12s %14s\n", "", "ns/insert", "ns/erase");
+    using MapEntry = pair<const uint64_t, Message>;
+    using ListPool = ObjectPool<ContainerNode<Message>>;
+    using MapPool = ObjectPool<ContainerNode<MapEntry>>;
+    using ListAllocator = ObjectPoolAllocator<Message, ContainerNode<Message>>;
+    using MapAllocator = ObjectPoolAllocator<MapEntry, ContainerNode<MapEntry>>;
+    char* pListMemory = new char[nodeCount * ListPool::s_BlockSize];
+    char* pMapMemory = new char[nodeCount * MapPool::s_BlockSize];
+    for (int pooled = 0; pooled < 2; ++pooled)
+    {
+        ListPool listPool(nodeCount, pListMemory);
+        MapPool mapPool(nodeCount, pMapMemory);
+        double listInsertNs = 0, listEraseNs = 0, mapInsertNs = 0, mapEraseNs = 0;
+        for (size_t round = 0; round < rounds; ++round)
+        {
+            auto timeContainer = [&](auto& container, auto insert, double& insertNs, double& eraseNs)
+            {
+                auto start = chrono::steady_clock::now();
+                for (size_t i = 0; i < nodeCount; ++i)
+                {
+                    insert(container, order[i]);
+                }
+                insertNs += ElapsedNs(start);
+
+                start = chrono::steady_clock::now();
+                container.clear();
+                eraseNs += ElapsedNs(start);
+            };
+            auto listInsert = [](auto& list, size_t i) { list.emplace_back(i, 1); };
+            auto mapInsert = [](auto& map, size_t i) { map.emplace(piecewise_construct, forward_as_tuple(i), forward_as_tuple(i, 1)); };
+
+            if (pooled)
+            {
+                list<Message, ListAllocator> messageList{ ListAllocator(listPool) };
+                map<uint64_t, Message, less<uint64_t>, MapAllocator> messageMap{ MapAllocator(mapPool) };
+                timeContainer(messageList, listInsert, listInsertNs, listEraseNs);
+                timeContainer(messageMap, mapInsert, mapInsertNs, mapEraseNs);
+            }
+            else
+            {
+                list<Message> messageList;
+                map<uint64_t, Message> messageMap;
+                timeContainer(messageList, listInsert, listInsertNs, listEraseNs);
+                timeContainer(messageMap, mapInsert, mapInsertNs, mapEraseNs);
+            }
+        }
+
+        printf("%28s %12.1f %14.1f\n", pooled ? "std::list, ObjectPool" : "std::list, std::allocator",
+            listInsertNs / (rounds * nodeCount), listEraseNs / (rounds * nodeCount));
+        printf("%28s %12.1f %14.1f\n", pooled ? "std::map, ObjectPool" : "std::map, std::allocator",
+            mapInsertNs / (rounds * nodeCount), mapEraseNs / (rounds * nodeCount));
+        if (pooled && listPool.GetStats().AllocCount + mapPool.GetStats().AllocCount < 2 * rounds * nodeCount)
+        {
+            printf("%28s some nodes did not fit the pools\n", "");
+        }
+    }
+    delete[] pListMemory;
+    delete[] pMapMemory;
+}
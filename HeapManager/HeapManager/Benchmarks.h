@@ -0,0 +1,26 @@
+#pragma once
+
+// Benchmarks are run with "HeapManager.exe --bench" and print their results to stdout
+void RunBenchmarks();
+
+void RunHeapAllocScalingBenchmark();
+void RunBlockOverheadBenchmark();
+void RunEngineLatencyBenchmark();
+void RunBitArrayBenchmark();
+void RunFixedSizeAllocatorChurnBenchmark();
+void RunThreadScalingBenchmark();
+void RunConcurrentAllocatorBenchmark();
+void RunProducerConsumerBenchmark();
+void RunSlabBurstBenchmark();
+void RunSizeClassBenchmark();
+void RunGrowableHeapBenchmark();
+void RunHugeReallocBenchmark();
+void RunReallocBenchmark();
+void RunBatchBenchmark();
+void RunStatsOverheadBenchmark();
+void RunFreeSpaceStatsBenchmark();
+void RunIncrementalCollectBenchmark();
+void RunCompactionBenchmark();
+void RunLinearAllocatorBenchmark();
+void RunMemoryResourceBenchmark();
+void RunObjectPoolBenchmark();
@@ -1,19 +1,41 @@
 #include "BitArray.h"
+#include "Platform.h"
+#include <bit>
 #include <cassert>
 #include <cstring>
-#include <intrin.h>
 
 BitArray::BitArray(size_t totalBits)
     : m_Size(totalBits),
-    m_NumElements((totalBits + 7) / 8)
+    m_NumElements(0),
+    m_NumLevels(0)
 {
-    m_BitArray = new uint8_t[m_NumElements];
+    // Each level has one bit per word of the level below, until a single word remains
+    size_t entries = totalBits;
+    do
+    {
+        assert(m_NumLevels < s_MaxLevels);
+
+        size_t words = (entries + s_BitsPerWord - 1) / s_BitsPerWord;
+        if (words == 0)
+            words = 1;
+
+        m_LevelOffset[m_NumLevels] = m_NumElements;
+        m_LevelWords[m_NumLevels] = words;
+        m_NumElements += words;
+        ++m_NumLevels;
+
+        entries = words;
+    } while (entries > 1);
+
+    // Not new[]: slabs build their FixedSizeAllocator's BitArray while holding
+    // the memory system lock, and new[] may come back to the size classes
+    m_BitArray = static_cast<uint64_t*>(_aligned_malloc(m_NumElements * sizeof(uint64_t), alignof(uint64_t)));
     ClearAll(); // Set all bits to 0
 }
 
 BitArray::~BitArray()
 {
-    delete[] m_BitArray;
+    _aligned_free(m_BitArray);
 }
 
 // Returns the total number of bits this BitArray manages
@@ -27,10 +49,10 @@ bool BitArray::IsBitSet(size_t index) const
 {
     assert(index < m_Size);
 
-    size_t byteIndex = index / 8;
-    size_t bitOffset = index % 8;
+    size_t wordIndex = index / s_BitsPerWord;
+    size_t bitOffset = index % s_BitsPerWord;
 
-    return (m_BitArray[byteIndex] & (1 << bitOffset)) != 0;
+    return (m_BitArray[wordIndex] & (uint64_t(1) << bitOffset)) != 0;
 }
 
 // Sets (turns on) a particular bit
@@ -38,10 +60,14 @@ void BitArray::SetBit(size_t index)
 {
     assert(index < m_Size);
 
-    size_t byteIndex = index / 8;
-    size_t bitOffset = index % 8;
+    size_t wordIndex = index / s_BitsPerWord;
+    size_t bitOffset = index % s_BitsPerWord;
 
-    m_BitArray[byteIndex] |= (1 << bitOffset);
+    m_BitArray[wordIndex] |= (uint64_t(1) << bitOffset);
+    if (m_BitArray[wordIndex] == ~uint64_t(0))
+    {
+        MarkWordFull(0, wordIndex);
+    }
 }
 
 // Clears (turns off) a particular bit
@@ -49,37 +75,145 @@ void BitArray::ClearBit(size_t index)
 {
     assert(index < m_Size);
 
-    size_t byteIndex = index / 8;
-    size_t bitOffset = index % 8;
+    size_t wordIndex = index / s_BitsPerWord;
+    size_t bitOffset = index % s_BitsPerWord;
+
+    bool wasFull = m_BitArray[wordIndex] == ~uint64_t(0);
+    m_BitArray[wordIndex] &= ~(uint64_t(1) << bitOffset);
+    if (wasFull)
+    {
+        MarkWordNotFull(0, wordIndex);
+    }
+}
+
+// Sets every bit of i_Bits in one word
+void BitArray::SetBits(size_t wordIndex, uint64_t bits)
+{
+    assert(wordIndex < m_LevelWords[0]);
+
+    m_BitArray[wordIndex] |= bits;
+    if (m_BitArray[wordIndex] == ~uint64_t(0))
+    {
+        MarkWordFull(0, wordIndex);
+    }
+}
+
+// Clears every bit of i_Bits in one word
+void BitArray::ClearBits(size_t wordIndex, uint64_t bits)
+{
+    assert(wordIndex < m_LevelWords[0]);
+
+    bool wasFull = m_BitArray[wordIndex] == ~uint64_t(0);
+    m_BitArray[wordIndex] &= ~bits;
+    if (wasFull && bits != 0)
+    {
+        MarkWordNotFull(0, wordIndex);
+    }
+}
+
+// Returns a word of bits with the padding past the last bit cleared
+uint64_t BitArray::GetWord(size_t wordIndex) const
+{
+    assert(wordIndex < m_LevelWords[0]);
+
+    uint64_t bits = m_BitArray[wordIndex];
+    size_t used = m_Size - wordIndex * s_BitsPerWord;
+    if (used < s_BitsPerWord)
+    {
+        bits &= (uint64_t(1) << used) - 1;
+    }
+    return bits;
+}
+
+// Finds the first word with a clear bit and sets its lowest clear bits, at most maxBits of them
+bool BitArray::SetFirstClearBits(size_t maxBits, size_t& outWordIndex, uint64_t& outBits)
+{
+    size_t index;
+    if (maxBits == 0 || !GetFirstClearBit(index))
+        return false;
+
+    outWordIndex = index / s_BitsPerWord;
+    uint64_t clear = ~m_BitArray[outWordIndex];
+    if (static_cast<size_t>(std::popcount(clear)) > maxBits)
+    {
+        // Keep the lowest maxBits of them
+        uint64_t taken = 0;
+        for (size_t i = 0; i < maxBits; ++i)
+        {
+            taken |= clear & (~clear + 1);
+            clear &= clear - 1;
+        }
+        clear = taken;
+    }
+
+    outBits = clear;
+    SetBits(outWordIndex, outBits);
+    return true;
+}
+
+// Records in the summary levels that a word just became full
+void BitArray::MarkWordFull(size_t level, size_t wordIndex)
+{
+    while (level + 1 < m_NumLevels)
+    {
+        uint64_t& summary = m_BitArray[m_LevelOffset[level + 1] + wordIndex / s_BitsPerWord];
+        summary |= uint64_t(1) << (wordIndex % s_BitsPerWord);
+        if (summary != ~uint64_t(0))
+            return;
+
+        ++level;
+        wordIndex /= s_BitsPerWord;
+    }
+}
 
-    m_BitArray[byteIndex] &= ~(1 << bitOffset);
+// Records in the summary levels that a full word now has a clear bit
+void BitArray::MarkWordNotFull(size_t level, size_t wordIndex)
+{
+    while (level + 1 < m_NumLevels)
+    {
+        uint64_t& summary = m_BitArray[m_LevelOffset[level + 1] + wordIndex / s_BitsPerWord];
+        bool wasFull = summary == ~uint64_t(0);
+        summary &= ~(uint64_t(1) << (wordIndex % s_BitsPerWord));
+        if (!wasFull)
+            return;
+
+        ++level;
+        wordIndex /= s_BitsPerWord;
+    }
 }
 
 // Clears all bits in the array
 void BitArray::ClearAll()
 {
-    std::memset(m_BitArray, 0, m_NumElements);
+    std::memset(m_BitArray, 0, m_NumElements * sizeof(uint64_t));
+
+    // Bits past the end of each level count as set so they are never reported clear
+    size_t entries = m_Size;
+    for (size_t level = 0; level < m_NumLevels; ++level)
+    {
+        size_t used = entries % s_BitsPerWord;
+        if (used != 0 || entries == 0)
+        {
+            m_BitArray[m_LevelOffset[level] + m_LevelWords[level] - 1] |= ~uint64_t(0) << used;
+        }
+        entries = m_LevelWords[level];
+    }
 }
 
 // Finds the first clear (0) bit and returns its index if found
 bool BitArray::GetFirstClearBit(size_t& outIndex) const
 {
-    for (size_t byteIndex = 0; byteIndex < m_NumElements; ++byteIndex)
+    // Walk down from the single top word, following the first non-full entry
+    size_t index = 0;
+    for (size_t level = m_NumLevels; level-- > 0; )
     {
-        uint8_t current = m_BitArray[byteIndex];
+        uint64_t current = m_BitArray[m_LevelOffset[level] + index];
+        if (current == ~uint64_t(0))
+            return false;
 
-        // Only check if there's at least one 0 bit in the byte
-        if (current != 0xFF)
-        {
-            unsigned long bitIndex;
-            // ~current flips the bits so a 0 bit becomes 1
-            if (_BitScanForward(&bitIndex, ~current))
-            {
-                outIndex = (byteIndex * 8) + bitIndex;
-                if (outIndex < m_Size)
-                    return true;
-            }
-        }
+        index = index * s_BitsPerWord + std::countr_zero(~current);
     }
-    return false;
+
+    outIndex = index;
+    return outIndex < m_Size;
 }
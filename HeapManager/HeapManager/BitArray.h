@@ -3,13 +3,27 @@
 #include <cstddef>
 #include <cstdint>
 
+// Bits are stored in 64-bit words. Summary levels above them keep one bit per
+// word of the level below that is set when that word is full, so finding the
+// first clear bit is one countr_zero per level.
 class BitArray 
 {
     private:
-        uint8_t* m_BitArray;
+        static const size_t s_BitsPerWord = 64;
+        static const size_t s_MaxLevels = 6;
+
+        uint64_t* m_BitArray;
         size_t m_Size;
         size_t m_NumElements;
 
+        // Level 0 is the bits themselves, the last level is a single word
+        size_t m_NumLevels;
+        size_t m_LevelOffset[s_MaxLevels];
+        size_t m_LevelWords[s_MaxLevels];
+
+        void MarkWordFull(size_t i_Level, size_t i_WordIndex);
+        void MarkWordNotFull(size_t i_Level, size_t i_WordIndex);
+
     public:
         BitArray(size_t i_NumBits);
         ~BitArray();
@@ -20,6 +34,14 @@ class BitArray
         void ClearBit(size_t i_Index);
         void ClearAll();
 
+        // Word-at-a-time versions for batches: SetFirstClearBits sets up to
+        // i_MaxBits clear bits of the first word that has any and returns them
+        // in o_Bits; false when every bit is set
+        bool SetFirstClearBits(size_t i_MaxBits, size_t& o_WordIndex, uint64_t& o_Bits);
+        void SetBits(size_t i_WordIndex, uint64_t i_Bits);
+        void ClearBits(size_t i_WordIndex, uint64_t i_Bits);
+        // One word of bits, for walking the set bits in order; bits past the end read as clear
+        uint64_t GetWord(size_t i_WordIndex) const;
+
         size_t GetBitCount() const;
 };
-
@@ -0,0 +1,73 @@
+#include "ConcurrentFixedSizeAllocator.h"
+#include <cassert>
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "ConcurrentFixedSizeAllocator needs a lock-free 64-bit atomic");
+
+// Constructor (every block starts on the free stack, lowest address on top)
+ConcurrentFixedSizeAllocator::ConcurrentFixedSizeAllocator(size_t blockSize, size_t blockCount, void* startMemory)
+    : m_BlockSize(blockSize), m_NumBlocks(blockCount), m_pMemory(startMemory), m_Head(0)
+{
+    assert(m_BlockSize > 0 && m_NumBlocks > 0 && m_NumBlocks < s_EmptyIndex && m_pMemory != nullptr);
+
+    m_pNextIndex = new std::atomic<uint32_t>[m_NumBlocks];
+    for (size_t i = 0; i < m_NumBlocks; ++i)
+    {
+        m_pNextIndex[i].store(i + 1 < m_NumBlocks ? static_cast<uint32_t>(i + 1) : s_EmptyIndex, std::memory_order_relaxed);
+    }
+    m_Head.store(0, std::memory_order_release);
+}
+
+// Destructor
+ConcurrentFixedSizeAllocator::~ConcurrentFixedSizeAllocator()
+{
+    delete[] m_pNextIndex;
+}
+
+// New head word: the given index with the old tag plus one
+uint64_t ConcurrentFixedSizeAllocator::MakeHead(uint64_t oldHead, uint32_t index)
+{
+    return (((oldHead >> 32) + 1) << 32) | index;
+}
+
+// Checks if a pointer lies inside this allocator's memory
+bool ConcurrentFixedSizeAllocator::Contains(void* ptr) const
+{
+    uintptr_t startAddr = reinterpret_cast<uintptr_t>(m_pMemory);
+    uintptr_t endAddr = startAddr + (m_BlockSize * m_NumBlocks);
+    uintptr_t checkAddr = reinterpret_cast<uintptr_t>(ptr);
+    return checkAddr >= startAddr && checkAddr < endAddr;
+}
+
+// Pops a free block, or returns nullptr if none are available
+void* ConcurrentFixedSizeAllocator::alloc()
+{
+    uint64_t head = m_Head.load(std::memory_order_acquire);
+    for (;;)
+    {
+        uint32_t index = static_cast<uint32_t>(head);
+        if (index == s_EmptyIndex)
+            return nullptr; // No free blocks
+
+        // If another thread takes this block first the tag moves on and the
+        // exchange below fails, so a stale next index is never installed
+        uint32_t nextIndex = m_pNextIndex[index].load(std::memory_order_relaxed);
+        if (m_Head.compare_exchange_weak(head, MakeHead(head, nextIndex), std::memory_order_acquire, std::memory_order_acquire))
+        {
+            return static_cast<char*>(m_pMemory) + (index * m_BlockSize);
+        }
+    }
+}
+
+// Pushes a previously allocated block back onto the free stack
+void ConcurrentFixedSizeAllocator::free(void* ptr)
+{
+    assert(Contains(ptr) && "Pointer out of range for this ConcurrentFixedSizeAllocator");
+
+    uint32_t index = static_cast<uint32_t>((static_cast<char*>(ptr) - static_cast<char*>(m_pMemory)) / m_BlockSize);
+
+    uint64_t head = m_Head.load(std::memory_order_relaxed);
+    do
+    {
+        m_pNextIndex[index].store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+    } while (!m_Head.compare_exchange_weak(head, MakeHead(head, index), std::memory_order_release, std::memory_order_relaxed));
+}
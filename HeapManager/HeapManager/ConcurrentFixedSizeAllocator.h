@@ -0,0 +1,34 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Thread-safe FixedSizeAllocator whose alloc/free are lock-free. Free blocks
+// form a Treiber stack of block indices. The head packs the top index with a
+// tag that changes on every update, so a pop that raced with a pop/push pair
+// of the same block (ABA) fails its compare-exchange instead of corrupting the list.
+class ConcurrentFixedSizeAllocator
+{
+private:
+    static const uint32_t s_EmptyIndex = 0xFFFFFFFF;
+
+    size_t m_BlockSize;
+    size_t m_NumBlocks;
+    void* m_pMemory;
+
+    std::atomic<uint64_t> m_Head;           // high 32 bits: tag, low 32 bits: top block index
+    std::atomic<uint32_t>* m_pNextIndex;    // next free block below each block on the stack
+
+    static uint64_t MakeHead(uint64_t i_OldHead, uint32_t i_Index);
+
+public:
+    ConcurrentFixedSizeAllocator(size_t i_BlockSize, size_t i_NumBlocks, void* i_pMemory);
+    ~ConcurrentFixedSizeAllocator();
+
+    ConcurrentFixedSizeAllocator(const ConcurrentFixedSizeAllocator&) = delete;
+    ConcurrentFixedSizeAllocator& operator=(const ConcurrentFixedSizeAllocator&) = delete;
+
+    void* alloc();
+    void free(void* ptr);
+    bool Contains(void* ptr) const;
+};
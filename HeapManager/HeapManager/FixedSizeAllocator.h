@@ -1,19 +1,351 @@
 #pragma once
+#include "AllocatorStats.h"
 #include "BitArray.h"
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <optional>
 
-class FixedSizeAllocator 
+enum class FixedSizeAllocatorMode {
+    Bitmap,     // every alloc searches the BitArray for a clear bit
+    FreeList    // freed blocks hold a next pointer and form a LIFO list, alloc/free are O(1)
+};
+
+// BlockSize fixes the block size at compile time, so the block-index division
+// in free/isAllocated compiles to a constant multiply. FixedSizeAllocator<>
+// takes the block size at construction instead, and precomputes its
+// reciprocal to multiply by when the allocator is small enough for it to be
+// exact, as every size-class slab is.
+template<size_t BlockSize = 0>
+class FixedSizeAllocator
 {
 private:
     size_t m_BlockSize;
+    uint64_t m_BlockSizeReciprocal;     // ceil(2^32 / block size), or 0 to divide
     size_t m_NumBlocks;
     void* m_pMemory;
-    BitArray m_BitArray;
+    std::optional<BitArray> m_BitArray;     // only built when allocations are tracked
+
+    FixedSizeAllocatorMode m_Mode;
+    bool m_TrackAllocations;    // always in Bitmap mode; FreeList mode keeps the BitArray only for isAllocated and leak checks
+    void* m_pFreeList;          // FreeList mode: most recently freed block first
+    size_t m_NextUnusedBlock;   // FreeList mode: blocks from here on have never been handed out
+    size_t m_NumAllocated;
+    AllocatorStats m_Stats;
+
+    struct ConstructTag {};
+    FixedSizeAllocator(ConstructTag, size_t i_BlockSize, size_t i_NumBlocks, void* i_pMemory,
+        FixedSizeAllocatorMode i_Mode, bool i_TrackAllocations);
+
+    static uint64_t GetBlockSizeReciprocal(size_t i_BlockSize, size_t i_NumBlocks);
+    size_t GetBlockIndex(void* ptr) const;
 
 public:
-    FixedSizeAllocator(size_t i_BlockSize, size_t i_NumBlocks, void* i_pMemory);
+#ifdef _DEBUG
+    static const bool s_DefaultTrackAllocations = true;
+#else
+    static const bool s_DefaultTrackAllocations = false;
+#endif
+
+    FixedSizeAllocator(size_t i_BlockSize, size_t i_NumBlocks, void* i_pMemory,
+        FixedSizeAllocatorMode i_Mode = FixedSizeAllocatorMode::Bitmap, bool i_TrackAllocations = s_DefaultTrackAllocations)
+        requires (BlockSize == 0)
+        : FixedSizeAllocator(ConstructTag(), i_BlockSize, i_NumBlocks, i_pMemory, i_Mode, i_TrackAllocations) {}
+    FixedSizeAllocator(size_t i_NumBlocks, void* i_pMemory,
+        FixedSizeAllocatorMode i_Mode = FixedSizeAllocatorMode::Bitmap, bool i_TrackAllocations = s_DefaultTrackAllocations)
+        requires (BlockSize != 0)
+        : FixedSizeAllocator(ConstructTag(), BlockSize, i_NumBlocks, i_pMemory, i_Mode, i_TrackAllocations) {}
     ~FixedSizeAllocator();
 
     void* alloc();
     void free(void* ptr);
+
+    // Batch versions of alloc/free: a bitmap word or one free-list splice
+    // covers many blocks. AllocBatch returns how many blocks it handed out,
+    // fewer than i_Count only when the allocator runs out.
+    size_t AllocBatch(size_t i_Count, void** o_pBlocks);
+    void FreeBatch(void** i_pBlocks, size_t i_Count);
+
+    // Calls i_Visit(pBlock) for every allocated block in address order, a
+    // BitArray word at a time. Needs allocation tracking; i_Visit must not
+    // allocate or free from this allocator.
+    template<typename Visitor>
+    void ForEachAllocated(Visitor i_Visit) const;
+    // Frees every block at once; a FreeList-mode allocator starts over from its first block
+    void FreeAll();
     bool isAllocated(void* ptr) const;
+    bool Contains(void* ptr) const;
+    size_t GetBlockSize() const { return BlockSize != 0 ? BlockSize : m_BlockSize; }
+    size_t GetNumBlocks() const { return m_NumBlocks; }
+    size_t GetNumAllocated() const { return m_NumAllocated; }
+    AllocatorStats GetStats() const { return m_Stats; }
 };
+
+// Constructor
+template<size_t BlockSize>
+FixedSizeAllocator<BlockSize>::FixedSizeAllocator(ConstructTag, size_t blockSize, size_t blockCount, void* startMemory,
+    FixedSizeAllocatorMode mode, bool trackAllocations)
+    : m_BlockSize(blockSize), m_BlockSizeReciprocal(GetBlockSizeReciprocal(blockSize, blockCount)), m_NumBlocks(blockCount), m_pMemory(startMemory),
+    m_Mode(mode), m_TrackAllocations(mode == FixedSizeAllocatorMode::Bitmap || trackAllocations),
+    m_pFreeList(nullptr), m_NextUnusedBlock(0), m_NumAllocated(0), m_Stats()
+{
+    assert(m_BlockSize > 0 && m_NumBlocks > 0 && m_pMemory != nullptr);
+    assert(m_Mode != FixedSizeAllocatorMode::FreeList || m_BlockSize >= sizeof(void*));
+    if (m_TrackAllocations)
+    {
+        m_BitArray.emplace(blockCount);
+    }
+}
+
+// Destructor
+template<size_t BlockSize>
+FixedSizeAllocator<BlockSize>::~FixedSizeAllocator()
+{
+#ifdef _DEBUG
+    // Check for any allocated blocks that were not freed
+    for (size_t i = 0; m_TrackAllocations && i < m_NumBlocks; ++i)
+    {
+        if (m_BitArray->IsBitSet(i))
+        {
+            printf("Warning: Potential memory leak at block %zu\n", i);
+        }
+    }
+#endif
+}
+
+// With M = ceil(2^32 / d), (n * M) >> 32 is n / d rounded down as long as
+// n * d stays within 2^32, which holds for every offset n into the blocks
+// when the whole span does. 0 when it doesn't, or the size is a constant.
+template<size_t BlockSize>
+uint64_t FixedSizeAllocator<BlockSize>::GetBlockSizeReciprocal(size_t blockSize, size_t blockCount)
+{
+    const uint64_t limit = uint64_t(1) << 32;
+    if (BlockSize != 0 || blockSize == 0 || blockCount > limit / blockSize / blockSize)
+        return 0;
+    return (limit + blockSize - 1) / blockSize;
+}
+
+// Index of the block containing ptr; ptr must be inside this allocator
+template<size_t BlockSize>
+size_t FixedSizeAllocator<BlockSize>::GetBlockIndex(void* ptr) const
+{
+    size_t offset = reinterpret_cast<uintptr_t>(ptr) - reinterpret_cast<uintptr_t>(m_pMemory);
+    if (BlockSize == 0 && m_BlockSizeReciprocal != 0)
+        return static_cast<size_t>((offset * m_BlockSizeReciprocal) >> 32);
+    return offset / GetBlockSize();
+}
+
+// Checks if a pointer lies inside this allocator's memory. Reads nothing that
+// alloc/free modify, so it is safe to call without holding a lock.
+template<size_t BlockSize>
+bool FixedSizeAllocator<BlockSize>::Contains(void* ptr) const
+{
+    uintptr_t startAddr = reinterpret_cast<uintptr_t>(m_pMemory);
+    uintptr_t endAddr = startAddr + (GetBlockSize() * m_NumBlocks);
+    uintptr_t checkAddr = reinterpret_cast<uintptr_t>(ptr);
+    return checkAddr >= startAddr && checkAddr < endAddr;
+}
+
+// Checks if a pointer belongs to a currently allocated block. Without
+// allocation tracking this is only an ownership (range) check.
+template<size_t BlockSize>
+bool FixedSizeAllocator<BlockSize>::isAllocated(void* ptr) const
+{
+    // If pointer is out of range, it's definitely not allocated by this allocator
+    if (!Contains(ptr))
+        return false;
+
+    if (!m_TrackAllocations)
+        return true;
+
+    // Compute index in the bit array
+    return m_BitArray->IsBitSet(GetBlockIndex(ptr));
+}
+
+// Allocates a free block, or returns nullptr if none are available
+template<size_t BlockSize>
+void* FixedSizeAllocator<BlockSize>::alloc()
+{
+    if (m_Mode == FixedSizeAllocatorMode::FreeList)
+    {
+        void* pBlock = m_pFreeList;
+        if (pBlock)
+        {
+            m_pFreeList = *static_cast<void**>(pBlock);
+        }
+        else if (m_NextUnusedBlock < m_NumBlocks)
+        {
+            pBlock = static_cast<char*>(m_pMemory) + (m_NextUnusedBlock++ * GetBlockSize());
+        }
+        else
+        {
+            return nullptr; // No free blocks
+        }
+
+        if (m_TrackAllocations)
+        {
+            m_BitArray->SetBit(GetBlockIndex(pBlock));
+        }
+        ++m_NumAllocated;
+        CountAllocation(m_Stats, GetBlockSize());
+        return pBlock;
+    }
+
+    size_t freeIndex;
+    if (m_BitArray->GetFirstClearBit(freeIndex))
+    {
+        m_BitArray->SetBit(freeIndex);
+        ++m_NumAllocated;
+        CountAllocation(m_Stats, GetBlockSize());
+        return static_cast<char*>(m_pMemory) + (freeIndex * GetBlockSize());
+    }
+    return nullptr; // No free blocks
+}
+
+// Frees a previously allocated block
+template<size_t BlockSize>
+void FixedSizeAllocator<BlockSize>::free(void* ptr)
+{
+    assert(Contains(ptr) && "Pointer out of range for this FixedSizeAllocator");
+
+    if (m_TrackAllocations)
+    {
+        size_t blockIndex = GetBlockIndex(ptr);
+        assert(m_BitArray->IsBitSet(blockIndex) && "Block freed twice");
+        m_BitArray->ClearBit(blockIndex);
+    }
+    --m_NumAllocated;
+    CountFree(m_Stats, GetBlockSize());
+
+    if (m_Mode == FixedSizeAllocatorMode::FreeList)
+    {
+        // The freed block itself becomes the new list head
+        *static_cast<void**>(ptr) = m_pFreeList;
+        m_pFreeList = ptr;
+    }
+}
+
+// Allocates up to count blocks into pBlocks; returns how many it found
+template<size_t BlockSize>
+size_t FixedSizeAllocator<BlockSize>::AllocBatch(size_t count, void** pBlocks)
+{
+    size_t allocated = 0;
+    if (m_Mode == FixedSizeAllocatorMode::FreeList)
+    {
+        while (allocated < count && m_pFreeList)
+        {
+            pBlocks[allocated++] = m_pFreeList;
+            m_pFreeList = *static_cast<void**>(m_pFreeList);
+        }
+
+        // The never-used tail is one contiguous run
+        size_t unused = m_NumBlocks - m_NextUnusedBlock;
+        size_t fromTail = count - allocated < unused ? count - allocated : unused;
+        char* pBlock = static_cast<char*>(m_pMemory) + m_NextUnusedBlock * GetBlockSize();
+        for (size_t i = 0; i < fromTail; ++i, pBlock += GetBlockSize())
+        {
+            pBlocks[allocated++] = pBlock;
+        }
+        m_NextUnusedBlock += fromTail;
+
+        if (m_TrackAllocations)
+        {
+            for (size_t i = 0; i < allocated; ++i)
+            {
+                m_BitArray->SetBit(GetBlockIndex(pBlocks[i]));
+            }
+        }
+        m_NumAllocated += allocated;
+        CountAllocation(m_Stats, allocated * GetBlockSize(), allocated);
+        return allocated;
+    }
+
+    // Claim a word's worth of clear bits at a time
+    size_t wordIndex;
+    uint64_t bits;
+    while (allocated < count && m_BitArray->SetFirstClearBits(count - allocated, wordIndex, bits))
+    {
+        for (; bits != 0; bits &= bits - 1)
+        {
+            size_t blockIndex = wordIndex * 64 + std::countr_zero(bits);
+            pBlocks[allocated++] = static_cast<char*>(m_pMemory) + blockIndex * GetBlockSize();
+        }
+    }
+    m_NumAllocated += allocated;
+    CountAllocation(m_Stats, allocated * GetBlockSize(), allocated);
+    return allocated;
+}
+
+// Frees count blocks; consecutive blocks that share a bitmap word are cleared together
+template<size_t BlockSize>
+void FixedSizeAllocator<BlockSize>::FreeBatch(void** pBlocks, size_t count)
+{
+    if (count == 0)
+        return;
+
+    if (m_TrackAllocations)
+    {
+        size_t wordIndex = GetBlockIndex(pBlocks[0]) / 64;
+        uint64_t bits = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            assert(Contains(pBlocks[i]) && "Pointer out of range for this FixedSizeAllocator");
+            size_t blockIndex = GetBlockIndex(pBlocks[i]);
+            assert(m_BitArray->IsBitSet(blockIndex) && "Block freed twice");
+
+            if (blockIndex / 64 != wordIndex)
+            {
+                m_BitArray->ClearBits(wordIndex, bits);
+                wordIndex = blockIndex / 64;
+                bits = 0;
+            }
+            bits |= uint64_t(1) << (blockIndex % 64);
+        }
+        m_BitArray->ClearBits(wordIndex, bits);
+    }
+    m_NumAllocated -= count;
+    CountFree(m_Stats, count * GetBlockSize(), count);
+
+    if (m_Mode == FixedSizeAllocatorMode::FreeList)
+    {
+        // Chain the batch in order and splice it onto the list once
+        for (size_t i = 0; i + 1 < count; ++i)
+        {
+            *static_cast<void**>(pBlocks[i]) = pBlocks[i + 1];
+        }
+        *static_cast<void**>(pBlocks[count - 1]) = m_pFreeList;
+        m_pFreeList = pBlocks[0];
+    }
+}
+
+template<size_t BlockSize>
+template<typename Visitor>
+void FixedSizeAllocator<BlockSize>::ForEachAllocated(Visitor visit) const
+{
+    assert(m_TrackAllocations && "ForEachAllocated needs allocation tracking");
+
+    // Only blocks before the never-used tail can be allocated
+    size_t usedBlocks = m_Mode == FixedSizeAllocatorMode::FreeList ? m_NextUnusedBlock : m_NumBlocks;
+    for (size_t wordIndex = 0; wordIndex * 64 < usedBlocks; ++wordIndex)
+    {
+        for (uint64_t bits = m_BitArray->GetWord(wordIndex); bits != 0; bits &= bits - 1)
+        {
+            size_t blockIndex = wordIndex * 64 + std::countr_zero(bits);
+            visit(static_cast<void*>(static_cast<char*>(m_pMemory) + blockIndex * GetBlockSize()));
+        }
+    }
+}
+
+template<size_t BlockSize>
+void FixedSizeAllocator<BlockSize>::FreeAll()
+{
+    if (m_TrackAllocations)
+    {
+        m_BitArray->ClearAll();
+    }
+    m_pFreeList = nullptr;
+    m_NextUnusedBlock = 0;
+    CountFree(m_Stats, m_NumAllocated * GetBlockSize(), m_NumAllocated);
+    m_NumAllocated = 0;
+}
@@ -0,0 +1,125 @@
+#include "HeapArena.h"
+
+HeapArena::HeapArena(void* pHeapMemory, size_t heapSize, size_t numDescriptors, HeapEngine engine)
+    : m_pHeapManager(new HeapManager(pHeapMemory, heapSize, numDescriptors, engine)), m_RemoteFrees(nullptr)
+{
+}
+
+HeapArena::HeapArena(size_t reserveSize, size_t initialSize, HeapEngine engine)
+    : m_pHeapManager(new HeapManager(reserveSize, initialSize, engine)), m_RemoteFrees(nullptr)
+{
+}
+
+HeapArena::~HeapArena()
+{
+    delete m_pHeapManager;
+}
+
+// Returns every block queued by other threads to the heap; m_Mutex must be held
+void HeapArena::DrainRemoteFrees()
+{
+    if (m_RemoteFrees.load(std::memory_order_relaxed) == nullptr)
+        return;
+
+    void* pBlock = m_RemoteFrees.exchange(nullptr, std::memory_order_acquire);
+    while (pBlock)
+    {
+        void* pNext = *static_cast<void**>(pBlock);
+        m_pHeapManager->Free(pBlock);
+        pBlock = pNext;
+    }
+}
+
+void* HeapArena::alloc(size_t size)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    DrainRemoteFrees();
+    return m_pHeapManager->alloc(size);
+}
+
+void* HeapArena::alloc(size_t size, unsigned int alignment)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    DrainRemoteFrees();
+    return m_pHeapManager->alloc(size, alignment);
+}
+
+void* HeapArena::TryAlloc(size_t size, unsigned int alignment)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    DrainRemoteFrees();
+    return m_pHeapManager->TryAlloc(size, alignment);
+}
+
+// Resizes a block of this arena, whichever thread it is assigned to
+void* HeapArena::Realloc(void* ptr, size_t size)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    DrainRemoteFrees();
+    return m_pHeapManager->Realloc(ptr, size);
+}
+
+// The lock is taken once for the whole batch
+size_t HeapArena::AllocBatch(size_t size, size_t count, void** pBlocks)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    DrainRemoteFrees();
+    return m_pHeapManager->AllocBatch(size, count, pBlocks);
+}
+
+void HeapArena::FreeBatch(void** pBlocks, size_t count)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_pHeapManager->FreeBatch(pBlocks, count);
+}
+
+// Frees a block from a thread assigned to this arena
+void HeapArena::free(void* ptr)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_pHeapManager->Free(ptr);
+}
+
+// Queues a block freed by a thread assigned to another arena. Every
+// HeapManager payload is large enough to hold the link.
+void HeapArena::RemoteFree(void* ptr)
+{
+    void* pHead = m_RemoteFrees.load(std::memory_order_relaxed);
+    do
+    {
+        *static_cast<void**>(ptr) = pHead;
+    } while (!m_RemoteFrees.compare_exchange_weak(pHead, ptr, std::memory_order_release, std::memory_order_relaxed));
+}
+
+void HeapArena::Collect()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    DrainRemoteFrees();
+    m_pHeapManager->Collect();
+}
+
+// Holds the lock for at most blockBudget blocks of the walk
+bool HeapArena::Collect(size_t blockBudget)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    DrainRemoteFrees();
+    return m_pHeapManager->Collect(blockBudget);
+}
+
+void HeapArena::SetDeferredCoalescing(bool defer)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_pHeapManager->SetDeferredCoalescing(defer);
+}
+
+size_t HeapArena::GetAllocationSize(void* ptr)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_pHeapManager->GetAllocationSize(ptr);
+}
+
+AllocatorStats HeapArena::GetStats()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_pHeapManager->GetStats();
+}
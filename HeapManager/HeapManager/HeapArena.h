@@ -0,0 +1,56 @@
+#pragma once
+#include "HeapManager.h"
+#include <atomic>
+#include <mutex>
+
+static const unsigned int s_MaxHeapArenas = 16;
+
+// A HeapManager with its own lock and a lock-free queue of frees made by
+// threads that don't own it. Remote frees are pushed onto an intrusive stack
+// through the freed blocks and are returned to the heap by the owning side on
+// its next allocation (or Collect), so a producer/consumer pair never shares a lock.
+class HeapArena
+{
+private:
+    HeapManager* m_pHeapManager;
+    std::mutex m_Mutex;
+    std::atomic<void*> m_RemoteFrees;
+
+    void DrainRemoteFrees();
+
+public:
+    HeapArena(void* i_pHeapMemory, size_t i_HeapSize, size_t i_NumDescriptors, HeapEngine i_Engine = HeapEngine::SegregatedFit);
+    HeapArena(size_t i_ReserveSize, size_t i_InitialSize, HeapEngine i_Engine = HeapEngine::SegregatedFit);
+    ~HeapArena();
+
+    HeapArena(const HeapArena&) = delete;
+    HeapArena& operator=(const HeapArena&) = delete;
+
+    void* alloc(size_t i_Size);
+    void* alloc(size_t i_Size, unsigned int i_Alignment);
+    void* TryAlloc(size_t i_Size, unsigned int i_Alignment);
+    void* Realloc(void* ptr, size_t i_Size);
+    size_t AllocBatch(size_t i_Size, size_t i_Count, void** o_pBlocks);
+    void FreeBatch(void** i_pBlocks, size_t i_Count);
+    void free(void* ptr);
+    void RemoteFree(void* ptr);
+    void Collect();
+    bool Collect(size_t i_BlockBudget);
+    void SetDeferredCoalescing(bool i_Defer);
+
+    // Takes the lock: the header's flag bits change when a neighbour is freed
+    size_t GetAllocationSize(void* ptr);
+    AllocatorStats GetStats();
+
+    // Lock-free: the heap publishes its free space counters as it changes them
+    FreeSpaceStats GetFreeSpaceStats() const { return m_pHeapManager->GetFreeSpaceStats(); }
+
+    // Checks against the reservation, which never changes, so no lock is needed
+    bool Contains(void* ptr) const
+    {
+        uintptr_t address = reinterpret_cast<uintptr_t>(ptr);
+        uintptr_t start = reinterpret_cast<uintptr_t>(m_pHeapManager->GetHeapMemory());
+        return address >= start && address - start < m_pHeapManager->GetReservedSize();
+    }
+    HeapManager* GetHeapManager() const { return m_pHeapManager; }
+};
@@ -1,15 +1,70 @@
 #include "HeapManager.h"
+#include "Platform.h"
+#include "VirtualMemory.h"
 #include <iostream>
 #include <cstdio>
-#include <Windows.h>
 #include <assert.h>
+#include <algorithm>
+#include <bit>
+#include <cinttypes>
+#include <cstring>
 
 using namespace std;
 
 // Constructor
-HeapManager::HeapManager(void* pHeapMem, size_t HeapSize, size_t NumDescriptors)
-    : m_pHeapMemory(pHeapMem), m_HeapSize(HeapSize), m_FreeList(nullptr)
+HeapManager::HeapManager(void* pHeapMem, size_t HeapSize, size_t NumDescriptors, HeapEngine Engine)
+    : m_pHeapMemory(pHeapMem), m_HeapSize(HeapSize), m_ReservedSize(HeapSize), m_pFirstBlock(nullptr), m_Engine(Engine),
+    m_OwnsMemory(false), m_PageSize(0), m_PurgeMinSize(~size_t(0)), m_CollectCount(0),
+    m_pCollectCursor(nullptr), m_DeferCoalescing(false), m_DeferredFrees(0), m_DeferredFreesAtPassStart(0),
+    m_pCompactCursor(nullptr), m_pHandles(nullptr), m_NumHandles(0), m_HandleCapacity(0), m_FirstFreeHandle(s_NoHandle), m_Stats(),
+    m_FreeBytes(0), m_FreeBlockCount(0), m_LargestFreeBlock(0), m_NumLargestFreeBlocks(0), m_LargestFreeBlockStale(false), m_BinBitmapSummary(0)
 {
+    Initialize(pHeapMem, HeapSize);
+}
+
+// Constructor (OS-backed, growable)
+HeapManager::HeapManager(size_t ReserveSize, size_t InitialSize, HeapEngine Engine)
+    : m_pHeapMemory(nullptr), m_HeapSize(0), m_ReservedSize(0), m_pFirstBlock(nullptr), m_Engine(Engine),
+    m_OwnsMemory(true), m_PageSize(GetVirtualPageSize()), m_CollectCount(0),
+    m_pCollectCursor(nullptr), m_DeferCoalescing(false), m_DeferredFrees(0), m_DeferredFreesAtPassStart(0),
+    m_pCompactCursor(nullptr), m_pHandles(nullptr), m_NumHandles(0), m_HandleCapacity(0), m_FirstFreeHandle(s_NoHandle), m_Stats(),
+    m_FreeBytes(0), m_FreeBlockCount(0), m_LargestFreeBlock(0), m_NumLargestFreeBlocks(0), m_LargestFreeBlockStale(false), m_BinBitmapSummary(0)
+{
+    m_PurgeMinSize = 2 * m_PageSize;
+    ReserveSize = (ReserveSize + m_PageSize - 1) & ~(m_PageSize - 1);
+    InitialSize = (std::max(InitialSize, m_PageSize) + m_PageSize - 1) & ~(m_PageSize - 1);
+
+    void* pHeapMem = ReserveVirtualMemory(ReserveSize);
+    if (!pHeapMem || InitialSize > ReserveSize || !CommitVirtualMemory(pHeapMem, InitialSize)) {
+        printf("Constructor Error: Unable to reserve %zu bytes of address space.\n", ReserveSize);
+        if (pHeapMem)
+            ReleaseVirtualMemory(pHeapMem, ReserveSize);
+        memset(m_FreeBins, 0, sizeof(m_FreeBins));
+        memset(m_BinBitmap, 0, sizeof(m_BinBitmap));
+        return;
+    }
+
+    m_pHeapMemory = pHeapMem;
+    m_HeapSize = InitialSize;
+    m_ReservedSize = ReserveSize;
+    Initialize(pHeapMem, InitialSize);
+}
+
+HeapManager::~HeapManager()
+{
+    if (m_OwnsMemory && m_pHeapMemory)
+    {
+        ReleaseVirtualMemory(m_pHeapMemory, m_ReservedSize);
+    }
+    _aligned_free(m_pHandles);
+}
+
+// Initialize (lays out the first free block and the epilogue)
+void HeapManager::Initialize(void* pHeapMem, size_t HeapSize)
+{
+    memset(m_FreeBins, 0, sizeof(m_FreeBins));
+    memset(m_BinBitmap, 0, sizeof(m_BinBitmap));
+
     if (pHeapMem == nullptr) {
         printf("Constructor Error: Provided heap memory pointer was null.\n");
         return;  // Early out if memory is invalid
@@ -20,18 +75,265 @@ HeapManager::HeapManager(void* pHeapMem, size_t HeapSize, size_t NumDescriptors)
         return;  // Early out if heap size is invalid
     }
 
-    printf("HeapManager ctor invoked. MemoryStart: %p, Size: %zu bytes\n", pHeapMem, HeapSize);
+    printf("HeapManager ctor invoked. MemoryStart: %p, Size: %zu bytes, Engine: %s\n", pHeapMem, HeapSize,
+        m_Engine == HeapEngine::TLSF ? "TLSF" : "SegregatedFit");
 
-    // Initialize the free list at the start of the provided memory
-    m_FreeList = reinterpret_cast<MemoryBlock*>(pHeapMem);
-    m_FreeList->Size = HeapSize - sizeof(MemoryBlock);
-    m_FreeList->IsFree = true;
-    m_FreeList->Next = nullptr;
-    m_FreeList->Prev = nullptr;
+    // Keep every block header one word below a granularity boundary, and the
+    // epilogue header too, so the heap's usable size is 8 mod 16 like a block's
+    uintptr_t start = reinterpret_cast<uintptr_t>(pHeapMem);
+    uintptr_t alignedStart = ((start + sizeof(MemoryBlock) + s_Granularity - 1) & ~(s_Granularity - 1)) - sizeof(MemoryBlock);
+    size_t skipped = alignedStart - start + sizeof(MemoryBlock);
+    size_t usableSize = HeapSize > skipped ? ((HeapSize - skipped) & ~(s_Granularity - 1)) + sizeof(MemoryBlock) : 0;
+
+    if (usableSize < 2 * sizeof(MemoryBlock) + s_MinumumToLeave) {
+        printf("Constructor Error: Heap size %zu is too small.\n", HeapSize);
+        return;
+    }
+
+    // One free block spans the heap, followed by a zero-sized allocated
+    // epilogue header so the last block never needs a bounds check
+    m_pFirstBlock = reinterpret_cast<MemoryBlock*>(alignedStart);
+    m_pFirstBlock->SizeAndFlags = usableSize - 2 * sizeof(MemoryBlock);
+    m_pFirstBlock->SetFree(true);
+    m_pFirstBlock->WriteFooter();
+
+    MemoryBlock* pEpilogue = m_pFirstBlock->GetNextBlock();
+    pEpilogue->SizeAndFlags = 0;
+    pEpilogue->SetPrevFree(true);
+
+    InsertFreeBlock(m_pFirstBlock);
 
     printf("HeapManager successfully initialized.\n");
 }
 
+// RoundSize (every payload can hold the free list links, and header plus
+// payload is a whole number of granules so the next payload stays aligned)
+size_t HeapManager::RoundSize(size_t Size)
+{
+    static_assert((s_MinumumToLeave + sizeof(MemoryBlock)) % s_Granularity == 0, "the smallest block must keep payloads aligned");
+
+    if (Size < s_MinumumToLeave)
+        return s_MinumumToLeave;
+    return ((Size + sizeof(MemoryBlock) + s_Granularity - 1) & ~(s_Granularity - 1)) - sizeof(MemoryBlock);
+}
+
+// GetBinIndex (maps a block size to its segregated free list)
+size_t HeapManager::GetBinIndex(size_t Size)
+{
+    if (Size < s_LinearBinLimit)
+        return Size / s_Granularity;
+
+    unsigned int log2 = static_cast<unsigned int>(std::bit_width(Size)) - 1;
+    size_t subBin = (Size >> (log2 - s_SubBinBits)) & (s_SubBinCount - 1);
+    return s_NumLinearBins + (log2 - s_LinearBinLimitLog2) * s_SubBinCount + subBin;
+}
+
+// GetBinLowerBound (smallest block size that maps to Bin; block sizes are 8
+// more than a multiple of the granularity, so that is the first such size at
+// or above the bin's range)
+size_t HeapManager::GetBinLowerBound(size_t Bin)
+{
+    size_t lowerBound;
+    if (Bin < s_NumLinearBins)
+    {
+        lowerBound = Bin * s_Granularity;
+    }
+    else
+    {
+        size_t log2 = s_LinearBinLimitLog2 + (Bin - s_NumLinearBins) / s_SubBinCount;
+        size_t subBin = (Bin - s_NumLinearBins) % s_SubBinCount;
+        lowerBound = (size_t(1) << log2) + (subBin << (log2 - s_SubBinBits));
+    }
+    return lowerBound + sizeof(MemoryBlock);
+}
+
+FreeBlockLinks* HeapManager::GetLinks(MemoryBlock* pBlock)
+{
+    return reinterpret_cast<FreeBlockLinks*>(pBlock + 1);
+}
+
+// GetFreeStamp (collection count at which a purgeable free block last changed)
+size_t* HeapManager::GetFreeStamp(MemoryBlock* pBlock)
+{
+    return reinterpret_cast<size_t*>(GetLinks(pBlock) + 1);
+}
+
+// AddRelaxed (updates a counter only this heap's user writes, so other threads
+// can read it without a lock)
+static void AddRelaxed(std::atomic<size_t>& counter, size_t delta)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+static size_t GetSizeBucket(size_t size)
+{
+    return std::bit_width(size) - 1;
+}
+
+// InsertFreeBlock (pushes a free block onto the front of its bin)
+void HeapManager::InsertFreeBlock(MemoryBlock* pBlock)
+{
+    size_t size = pBlock->GetSize();
+    size_t bin = GetBinIndex(size);
+    FreeBlockLinks* pLinks = GetLinks(pBlock);
+
+    pLinks->PrevFree = nullptr;
+    pLinks->NextFree = m_FreeBins[bin];
+    if (m_FreeBins[bin])
+    {
+        GetLinks(m_FreeBins[bin])->PrevFree = pBlock;
+    }
+    m_FreeBins[bin] = pBlock;
+
+    m_BinBitmap[bin / 64] |= uint64_t(1) << (bin % 64);
+    m_BinBitmapSummary |= uint64_t(1) << (bin / 64);
+
+    if (size >= m_PurgeMinSize)
+    {
+        *GetFreeStamp(pBlock) = m_CollectCount;
+    }
+
+    AddRelaxed(m_FreeBytes, size);
+    AddRelaxed(m_FreeBlockCount, 1);
+    AddRelaxed(m_FreeBlockHistogram[GetSizeBucket(size)], 1);
+    size_t largest = m_LargestFreeBlock.load(std::memory_order_relaxed);
+    if (size > largest || m_LargestFreeBlockStale)
+    {
+        if (size >= largest)
+        {
+            m_LargestFreeBlock.store(size, std::memory_order_relaxed);
+            m_NumLargestFreeBlocks = 1;
+            m_LargestFreeBlockStale = false;
+        }
+    }
+    else if (size == largest)
+    {
+        ++m_NumLargestFreeBlocks;
+    }
+}
+
+// RemoveFreeBlock (unlinks a free block from its bin)
+void HeapManager::RemoveFreeBlock(MemoryBlock* pBlock)
+{
+    size_t size = pBlock->GetSize();
+    size_t bin = GetBinIndex(size);
+    FreeBlockLinks* pLinks = GetLinks(pBlock);
+
+    if (pLinks->PrevFree)
+    {
+        GetLinks(pLinks->PrevFree)->NextFree = pLinks->NextFree;
+    }
+    else
+    {
+        m_FreeBins[bin] = pLinks->NextFree;
+    }
+
+    if (pLinks->NextFree)
+    {
+        GetLinks(pLinks->NextFree)->PrevFree = pLinks->PrevFree;
+    }
+
+    if (!m_FreeBins[bin])
+    {
+        m_BinBitmap[bin / 64] &= ~(uint64_t(1) << (bin % 64));
+        if (m_BinBitmap[bin / 64] == 0)
+        {
+            m_BinBitmapSummary &= ~(uint64_t(1) << (bin / 64));
+        }
+    }
+
+    AddRelaxed(m_FreeBytes, 0 - size);
+    AddRelaxed(m_FreeBlockCount, 0 - size_t(1));
+    AddRelaxed(m_FreeBlockHistogram[GetSizeBucket(size)], 0 - size_t(1));
+    if (size == m_LargestFreeBlock.load(std::memory_order_relaxed) && !m_LargestFreeBlockStale && --m_NumLargestFreeBlocks == 0)
+    {
+        m_LargestFreeBlockStale = true;
+    }
+}
+
+// FindNonEmptyBin (first bin at or above FirstBin that holds a free block)
+bool HeapManager::FindNonEmptyBin(size_t FirstBin, size_t& o_Bin) const
+{
+    if (FirstBin >= s_NumBins)
+        return false;
+
+    size_t word = FirstBin / 64;
+    uint64_t bits = m_BinBitmap[word] & (~uint64_t(0) << (FirstBin % 64));
+    if (bits == 0)
+    {
+        uint64_t summary = (word + 1 < 64) ? (m_BinBitmapSummary & (~uint64_t(0) << (word + 1))) : 0;
+        if (summary == 0)
+            return false;
+
+        word = std::countr_zero(summary);
+        bits = m_BinBitmap[word];
+    }
+
+    o_Bin = word * 64 + std::countr_zero(bits);
+    return true;
+}
+
+// GetAlignedPadding (bytes to skip so the payload is aligned; a non-zero gap
+// must be large enough to become a free block of its own)
+static size_t GetAlignedPadding(MemoryBlock* pBlock, size_t Alignment)
+{
+    uintptr_t baseAddr = reinterpret_cast<uintptr_t>(pBlock + 1);
+    uintptr_t alignedAddress = (baseAddr + Alignment - 1) & ~(Alignment - 1);
+
+    if (alignedAddress != baseAddr && alignedAddress - baseAddr < sizeof(MemoryBlock) + HeapManager::s_MinumumToLeave)
+    {
+        alignedAddress = (baseAddr + sizeof(MemoryBlock) + HeapManager::s_MinumumToLeave + Alignment - 1) & ~(Alignment - 1);
+    }
+    return alignedAddress - baseAddr;
+}
+
+// FindFreeBlock (SegregatedFit: first fit inside the request's bin, then the
+// head of the next non-empty bin that is guaranteed to fit. The first-fit
+// scan gives up on the small bins after s_FirstFitScanLimit misses, unless
+// no bigger block exists, so a bin full of blocks just too small stays cheap)
+MemoryBlock* HeapManager::FindFreeBlock(size_t Size, size_t Alignment)
+{
+    size_t worstCaseSize = Size;
+    if (Alignment > s_Granularity)
+    {
+        worstCaseSize += Alignment + sizeof(MemoryBlock) + s_MinumumToLeave;
+    }
+    size_t guaranteedBin = GetBinIndex(worstCaseSize);
+    if (GetBinLowerBound(guaranteedBin) < worstCaseSize)
+    {
+        ++guaranteedBin;
+    }
+
+    // TLSF never looks inside a list: the head of the first non-empty bin at or
+    // above the rounded-up size always fits, so the search is two bit scans
+    size_t bin;
+    if (m_Engine == HeapEngine::TLSF)
+    {
+        return FindNonEmptyBin(guaranteedBin, bin) ? m_FreeBins[bin] : nullptr;
+    }
+
+    bin = GetBinIndex(Size);
+    size_t misses = 0;
+    while (FindNonEmptyBin(bin, bin))
+    {
+        if (bin >= guaranteedBin)
+            return m_FreeBins[bin];
+
+        for (MemoryBlock* pBlock = m_FreeBins[bin]; pBlock; pBlock = GetLinks(pBlock)->NextFree)
+        {
+            size_t padding = (Alignment > s_Granularity) ? GetAlignedPadding(pBlock, Alignment) : 0;
+            if (pBlock->GetSize() >= Size + padding)
+                return pBlock;
+
+            size_t fitBin;
+            if (++misses == s_FirstFitScanLimit && FindNonEmptyBin(guaranteedBin, fitBin))
+                return m_FreeBins[fitBin];
+        }
+        ++bin;
+    }
+    return nullptr;
+}
+
 // Contains (checks if a pointer is within the heap range)
 bool HeapManager::Contains(void* ptr)
 {
@@ -45,67 +347,103 @@ bool HeapManager::Contains(void* ptr)
 bool HeapManager::IsAllocated(void* ptr)
 {
     MemoryBlock* pBlock = reinterpret_cast<MemoryBlock*>(reinterpret_cast<char*>(ptr) - sizeof(MemoryBlock));
-    return !pBlock->IsFree;
+    return !pBlock->IsFree();
 }
 
-// GetLargestFreeBlock
-size_t HeapManager::GetLargestFreeBlock()
+// GetAllocationSize (usable payload of an allocated block, at least the requested size)
+size_t HeapManager::GetAllocationSize(void* ptr)
 {
+    MemoryBlock* pBlock = reinterpret_cast<MemoryBlock*>(reinterpret_cast<char*>(ptr) - sizeof(MemoryBlock));
+    return pBlock->GetSize();
+}
+
+// UpdateLargestFreeBlock (called at the end of every operation that takes a
+// free block for an allocation; coalescing always reinserts a block bigger
+// than the ones it removed. Only searches the highest non-empty bin, and only
+// when the last free block of the largest size was taken and nothing as big
+// replaced it, so taking one of many equal largest blocks stays O(1))
+void HeapManager::UpdateLargestFreeBlock()
+{
+    if (!m_LargestFreeBlockStale)
+        return;
+    m_LargestFreeBlockStale = false;
+
     size_t maxSize = 0;
-    MemoryBlock* pBlock = m_FreeList;
-    while (pBlock)
+    size_t maxCount = 0;
+    if (m_BinBitmapSummary != 0)
     {
-        if (pBlock->IsFree && pBlock->Size > maxSize)
+        size_t word = std::bit_width(m_BinBitmapSummary) - 1;
+        size_t bin = word * 64 + std::bit_width(m_BinBitmap[word]) - 1;
+        for (MemoryBlock* pBlock = m_FreeBins[bin]; pBlock; pBlock = GetLinks(pBlock)->NextFree)
         {
-            maxSize = pBlock->Size;
+            if (pBlock->GetSize() > maxSize)
+            {
+                maxSize = pBlock->GetSize();
+                maxCount = 0;
+            }
+            maxCount += pBlock->GetSize() == maxSize;
         }
-        pBlock = pBlock->Next;
     }
-    return maxSize;
+    m_LargestFreeBlock.store(maxSize, std::memory_order_relaxed);
+    m_NumLargestFreeBlocks = maxCount;
+}
+
+// GetFreeSpaceStats
+FreeSpaceStats HeapManager::GetFreeSpaceStats() const
+{
+    FreeSpaceStats stats;
+    stats.FreeBytes = m_FreeBytes.load(std::memory_order_relaxed);
+    stats.FreeBlockCount = m_FreeBlockCount.load(std::memory_order_relaxed);
+    stats.LargestFreeBlock = m_LargestFreeBlock.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < FreeSpaceStats::s_NumSizeBuckets; ++i)
+    {
+        stats.FreeBlockHistogram[i] = m_FreeBlockHistogram[i].load(std::memory_order_relaxed);
+    }
+    return stats;
 }
 
 // ShowFreeBlocks
 void HeapManager::ShowFreeBlocks()
 {
-    MemoryBlock* pBlock = m_FreeList;
+    MemoryBlock* pBlock = m_pFirstBlock;
     std::cout << "Listing Free Blocks:\n";
-    while (pBlock)
+    while (pBlock && pBlock->GetSize() != 0)
     {
-        if (pBlock->IsFree)
+        if (pBlock->IsFree())
         {
-            std::cout << " Free Block -> Size: " << pBlock->Size << "\n";
+            std::cout << " Free Block -> Size: " << pBlock->GetSize() << "\n";
         }
-        pBlock = pBlock->Next;
+        pBlock = pBlock->GetNextBlock();
     }
 }
 
 // ShowOutstandingAllocations
 void HeapManager::ShowOutstandingAllocations()
 {
-    MemoryBlock* pBlock = m_FreeList;
+    MemoryBlock* pBlock = m_pFirstBlock;
     std::cout << "Outstanding (Allocated) Blocks:\n";
-    while (pBlock)
+    while (pBlock && pBlock->GetSize() != 0)
     {
-        if (!pBlock->IsFree)
+        if (!pBlock->IsFree())
         {
-            std::cout << " Allocated Block -> Size: " << pBlock->Size << "\n";
+            std::cout << " Allocated Block -> Size: " << pBlock->GetSize() << "\n";
         }
-        pBlock = pBlock->Next;
+        pBlock = pBlock->GetNextBlock();
     }
 }
 
 // DisplayHeap (prints out all blocks, free or allocated)
 void HeapManager::DisplayHeap()
 {
-    MemoryBlock* pBlock = m_FreeList;
+    MemoryBlock* pBlock = m_pFirstBlock;
     cout << "Heap Status Overview:" << endl;
-    while (pBlock)
+    while (pBlock && pBlock->GetSize() != 0)
     {
         cout << " Block @ " << pBlock
-            << " | Size: " << pBlock->Size
-            << " | IsFree: " << (pBlock->IsFree ? "Yes" : "No")
+            << " | Size: " << pBlock->GetSize()
+            << " | IsFree: " << (pBlock->IsFree() ? "Yes" : "No")
             << endl;
-        pBlock = pBlock->Next;
+        pBlock = pBlock->GetNextBlock();
     }
 }
 
@@ -117,16 +455,29 @@ void* HeapManager::alloc(size_t Size)
         return nullptr;
     }
 
-    MemoryBlock* pBlock = m_FreeList;
-    while (pBlock)
+    if (ExceedsHeap(Size)) {
+        printf("HeapManager::alloc failed: Requested size %zu is larger than the heap\n", Size);
+        return nullptr;
+    }
+
+    Size = RoundSize(Size);
+    MemoryBlock* pBlock = FindFreeBlock(Size, 0);
+    if (!pBlock)
     {
-        if (pBlock->IsFree && pBlock->Size >= Size)
-        {
-            SplitBlock(pBlock, Size);
-            pBlock->IsFree = false;
-            return reinterpret_cast<void*>(reinterpret_cast<char*>(pBlock + 1));
-        }
-        pBlock = pBlock->Next;
+        pBlock = CoalesceForFit(Size, 0);
+    }
+    if (!pBlock && Grow(Size))
+    {
+        pBlock = FindFreeBlock(Size, 0);
+    }
+    if (pBlock)
+    {
+        RemoveFreeBlock(pBlock);
+        MarkAllocated(pBlock);
+        SplitBlock(pBlock, Size);
+        UpdateLargestFreeBlock();
+        CountAllocation(m_Stats, pBlock->GetSize());
+        return reinterpret_cast<void*>(reinterpret_cast<char*>(pBlock + 1));
     }
 
     printf("HeapManager::alloc failed: No suitable free block for requested size %zu\n", Size);
@@ -141,39 +492,188 @@ void* HeapManager::alloc(size_t Size, unsigned int Alignment)
         return nullptr;
     }
 
-    MemoryBlock* pBlock = m_FreeList;
-    while (pBlock)
+    if (Alignment <= s_Granularity)
+        return alloc(Size);
+
+    if (ExceedsHeap(Size) || ExceedsHeap(Alignment)) {
+        printf("HeapManager::alloc (aligned) failed: Requested size %zu is larger than the heap\n", Size);
+        return nullptr;
+    }
+
+    void* ptr = TryAlloc(Size, Alignment);
+    if (!ptr)
     {
-        if (pBlock->IsFree && pBlock->Size >= Size)
-        {
-            uintptr_t baseAddr = reinterpret_cast<uintptr_t>(pBlock + 1);
-            uintptr_t alignedAddress = (baseAddr + Alignment - 1) & ~(Alignment - 1);
-            size_t padding = alignedAddress - baseAddr;
-            size_t totalSizeNeeded = Size + padding;
+        printf("HeapManager::alloc (aligned) failed: No free block for size %zu\n", RoundSize(Size));
+    }
+    return ptr;
+}
 
-            if (pBlock->Size >= totalSizeNeeded)
-            {
-                // If we need some alignment offset, split off that portion
-                if (padding > 0)
-                {
-                    SplitBlock(pBlock, padding);
-                    pBlock = pBlock->Next; // Move to the newly split block
-                }
+// TryAlloc (the aligned search itself; nullptr without a message when nothing fits)
+void* HeapManager::TryAlloc(size_t Size, unsigned int Alignment)
+{
+    if (ExceedsHeap(Size) || ExceedsHeap(Alignment))
+        return nullptr;
 
-                SplitBlock(pBlock, Size);
-                pBlock->IsFree = false;
+    Size = RoundSize(Size);
+    MemoryBlock* pBlock = FindFreeBlock(Size, Alignment);
+    if (!pBlock)
+    {
+        pBlock = CoalesceForFit(Size, Alignment);
+    }
+    if (!pBlock && Grow(Alignment > s_Granularity ? Size + Alignment + sizeof(MemoryBlock) + s_MinumumToLeave : Size))
+    {
+        pBlock = FindFreeBlock(Size, Alignment);
+    }
+    if (!pBlock)
+        return nullptr;
 
-                return reinterpret_cast<void*>(alignedAddress);
-            }
+    RemoveFreeBlock(pBlock);
+
+    // If we need some alignment offset, split off that portion as a free block
+    size_t padding = (Alignment > s_Granularity) ? GetAlignedPadding(pBlock, Alignment) : 0;
+    if (padding > 0)
+    {
+        size_t totalSize = pBlock->GetSize();
+        pBlock->SetSize(padding - sizeof(MemoryBlock));
+        pBlock->WriteFooter();
+        InsertFreeBlock(pBlock);
+
+        MemoryBlock* pAlignedBlock = pBlock->GetNextBlock();
+        pAlignedBlock->SizeAndFlags = totalSize - padding;
+        pAlignedBlock->SetPrevFree(true);
+        pBlock = pAlignedBlock; // Move to the newly split block
+    }
+
+    MarkAllocated(pBlock);
+    SplitBlock(pBlock, Size);
+    UpdateLargestFreeBlock();
+    CountAllocation(m_Stats, pBlock->GetSize());
+
+    return reinterpret_cast<void*>(pBlock + 1);
+}
+
+// AllocBatch (takes one free block off its bin for as many blocks as it holds,
+// cutting them off back to back, and bins the remainder once)
+size_t HeapManager::AllocBatch(size_t Size, size_t Count, void** o_ptrs)
+{
+    if (ExceedsHeap(Size))
+        return 0;
+
+    Size = RoundSize(Size);
+    size_t stride = Size + sizeof(MemoryBlock);
+
+    size_t allocated = 0;
+    while (allocated < Count)
+    {
+        // Prefer a block that holds the whole rest of the batch
+        size_t remaining = Count - allocated;
+        size_t runSize = stride > m_ReservedSize / remaining ? Size : remaining * stride - sizeof(MemoryBlock);
+        MemoryBlock* pBlock = FindFreeBlock(runSize, 0);
+        if (!pBlock)
+        {
+            pBlock = FindFreeBlock(Size, 0);
+        }
+        if (!pBlock)
+        {
+            pBlock = CoalesceForFit(Size, 0);
+        }
+        if (!pBlock && (Grow(runSize) || Grow(Size)))
+        {
+            pBlock = FindFreeBlock(Size, 0);
         }
-        pBlock = pBlock->Next;
+        if (!pBlock)
+            break;
+
+        RemoveFreeBlock(pBlock);
+        MarkAllocated(pBlock);
+        size_t runStart = allocated;
+        o_ptrs[allocated++] = pBlock + 1;
+        while (allocated < Count && pBlock->GetSize() >= 2 * Size + sizeof(MemoryBlock))
+        {
+            size_t restSize = pBlock->GetSize() - stride;
+            pBlock->SetSize(Size);
+            pBlock = pBlock->GetNextBlock();
+            pBlock->SizeAndFlags = restSize;
+            o_ptrs[allocated++] = pBlock + 1;
+        }
+        SplitBlock(pBlock, Size);
+
+        // Every block of the run is Size bytes except the last, which may keep a sliver
+        size_t runLength = allocated - runStart;
+        CountAllocation(m_Stats, (runLength - 1) * Size + pBlock->GetSize(), runLength);
     }
+    UpdateLargestFreeBlock();
+    return allocated;
+}
 
-    printf("HeapManager::alloc (aligned) failed: No free block for size %zu\n", Size);
-    return nullptr;
+// FreeBatch (each block still coalesces with its neighbours)
+void HeapManager::FreeBatch(void** ptrs, size_t Count)
+{
+    for (size_t i = 0; i < Count; ++i)
+    {
+        Free(ptrs[i]);
+    }
 }
 
-// Free
+// Realloc (shrinks with SplitBlock, grows into a free next block, committing
+// more of an OS-backed heap first when the block is the last one; only moves
+// the block when neither works)
+void* HeapManager::Realloc(void* ptr, size_t Size)
+{
+    if (!ptr)
+        return alloc(Size);
+
+    MemoryBlock* pBlock = reinterpret_cast<MemoryBlock*>(reinterpret_cast<char*>(ptr) - sizeof(MemoryBlock));
+    if (!Contains(pBlock) || pBlock->IsFree() || ExceedsHeap(Size))
+        return nullptr;
+
+    Size = RoundSize(Size);
+    size_t currentSize = pBlock->GetSize();
+    if (Size <= currentSize)
+    {
+        // The split-off tail may border another free block
+        SplitBlock(pBlock, Size);
+        Coalesce(pBlock->GetNextBlock());
+        m_Stats.BytesInUse -= currentSize - pBlock->GetSize();
+        return ptr;
+    }
+
+    MemoryBlock* pNext = pBlock->GetNextBlock();
+    size_t available = pNext->IsFree() ? currentSize + sizeof(MemoryBlock) + pNext->GetSize() : currentSize;
+    MemoryBlock* pLast = pNext->IsFree() ? pNext->GetNextBlock() : pNext;
+    if (available < Size && pLast->GetSize() == 0 && Grow(Size - available))
+    {
+        pNext = pBlock->GetNextBlock();
+    }
+    if (pNext->IsFree() && currentSize + sizeof(MemoryBlock) + pNext->GetSize() >= Size)
+    {
+        RemoveFreeBlock(pNext);
+        RetargetCursors(pNext, pBlock);
+        pBlock->SetSize(currentSize + sizeof(MemoryBlock) + pNext->GetSize());
+        MarkAllocated(pBlock);
+        SplitBlock(pBlock, Size);
+        UpdateLargestFreeBlock();
+        CountAllocation(m_Stats, pBlock->GetSize() - currentSize, 0);
+        return ptr;
+    }
+
+    void* pNewMemory = alloc(Size);
+    if (!pNewMemory)
+        return nullptr;
+    memcpy(pNewMemory, ptr, currentSize);
+    Free(ptr);
+    return pNewMemory;
+}
+
+// MarkAllocated (clears the free bit and tells the next block its neighbour is in use)
+void HeapManager::MarkAllocated(MemoryBlock* pBlock)
+{
+    pBlock->SetFree(false);
+    pBlock->GetNextBlock()->SetPrevFree(false);
+}
+
+// Free (both neighbours are found through the boundary tags, so this is O(1);
+// with deferred coalescing the block goes into its bin unmerged)
 bool HeapManager::Free(void* ptr)
 {
     if (!ptr)
@@ -181,87 +681,491 @@ bool HeapManager::Free(void* ptr)
 
     // Identify block metadata
     MemoryBlock* pBlock = reinterpret_cast<MemoryBlock*>(reinterpret_cast<char*>(ptr) - sizeof(MemoryBlock));
-    if (!Contains(pBlock))
+    if (!Contains(pBlock) || pBlock->IsFree())
         return false;
 
-    pBlock->IsFree = true;
-    Coalesce(pBlock);  // Attempt to merge with neighboring free blocks
+    CountFree(m_Stats, pBlock->GetSize());
+    pBlock->SetFree(true);
+    pBlock->WriteFooter();
+    pBlock->GetNextBlock()->SetPrevFree(true);
+    InsertFreeBlock(pBlock);
+    if (m_DeferCoalescing)
+    {
+        ++m_DeferredFrees;
+    }
+    else
+    {
+        Coalesce(pBlock);  // Attempt to merge with neighboring free blocks
+    }
 
     return true;
 }
 
-// Collect (calls Coalesce on all free blocks)
+// Collect (one whole pass over the heap, starting again from the first block)
 void HeapManager::Collect()
 {
-    MemoryBlock* pBlock = m_FreeList;
-    while (pBlock)
+    m_pCollectCursor = nullptr;
+    CollectStep(~size_t(0), true);
+}
+
+// Collect (budgeted: bounds the pause to BlockBudget blocks)
+bool HeapManager::Collect(size_t BlockBudget)
+{
+    return CollectStep(BlockBudget, true);
+}
+
+// CollectStep (visits up to BlockBudget blocks from the cursor, merging each
+// free block with its free neighbours and, for Collect, purging it once it
+// has been idle; returns true when it reaches the end of the heap)
+bool HeapManager::CollectStep(size_t BlockBudget, bool Purge)
+{
+    if (!m_pFirstBlock)
+        return true;
+
+    if (!m_pCollectCursor)
     {
-        if (pBlock->IsFree)
+        m_pCollectCursor = m_pFirstBlock;
+        m_DeferredFreesAtPassStart = m_DeferredFrees;
+        if (Purge)
         {
-            Coalesce(pBlock);
+            ++m_CollectCount;
         }
-        pBlock = pBlock->Next;
+    }
+
+    MemoryBlock* pBlock = m_pCollectCursor;
+    for (size_t visited = 0; visited < BlockBudget && pBlock->GetSize() != 0; ++visited)
+    {
+        if (pBlock->IsFree())
+        {
+            pBlock = Coalesce(pBlock);
+            if (Purge && m_OwnsMemory)
+            {
+                PurgeIdleBlock(pBlock);
+            }
+        }
+        pBlock = pBlock->GetNextBlock();
+    }
+
+    if (pBlock->GetSize() != 0)
+    {
+        m_pCollectCursor = pBlock;
+        return false;
+    }
+
+    // Every block freed before the pass started has been merged
+    m_pCollectCursor = nullptr;
+    m_DeferredFrees -= m_DeferredFreesAtPassStart;
+    m_DeferredFreesAtPassStart = 0;
+    return true;
+}
+
+// CoalesceForFit (deferred coalescing: when no free block fits, merges the
+// heap a chunk at a time from the collection cursor until one does or a
+// whole pass has been made since the call started. Growable heaps drain too:
+// growing past unmerged frees only commits pages the frees already cover)
+MemoryBlock* HeapManager::CoalesceForFit(size_t Size, size_t Alignment)
+{
+    if (m_DeferredFrees == 0)
+        return nullptr;
+
+    bool wrapped = false;
+    while (true)
+    {
+        bool passDone = CollectStep(s_FitCoalesceBudget, false);
+        MemoryBlock* pBlock = FindFreeBlock(Size, Alignment);
+        if (pBlock || (passDone && wrapped) || m_DeferredFrees == 0)
+            return pBlock;
+        wrapped |= passDone;
     }
 }
 
-// Coalesce (merges adjacent free blocks into a single bigger block)
-void HeapManager::Coalesce(MemoryBlock* pBlock)
+// RetargetCursors (a block header was merged away or moved: the collection
+// and compaction walks that would resume at From resume at To)
+void HeapManager::RetargetCursors(MemoryBlock* pFrom, MemoryBlock* pTo)
 {
-    if (!Contains(pBlock))
+    if (m_pCollectCursor == pFrom)
+    {
+        m_pCollectCursor = pTo;
+    }
+    if (m_pCompactCursor == pFrom)
+    {
+        m_pCompactCursor = pTo;
+    }
+}
+
+// PurgeIdleBlock (hands the whole pages inside a long-idle free block back to
+// the OS; the header, links, stamp and footer stay resident)
+void HeapManager::PurgeIdleBlock(MemoryBlock* pBlock)
+{
+    if (pBlock->GetSize() < m_PurgeMinSize)
         return;
 
-    // Merge with the next block if it's free
-    if (pBlock->Next && Contains(pBlock->Next) && pBlock->Next->IsFree)
+    size_t* pStamp = GetFreeStamp(pBlock);
+    if (*pStamp != s_PurgedStamp && m_CollectCount - *pStamp >= s_PurgeIdleCollects)
     {
-        pBlock->Size += sizeof(MemoryBlock) + pBlock->Next->Size;
-        pBlock->Next = pBlock->Next->Next;
+        uintptr_t purgeStart = (reinterpret_cast<uintptr_t>(pStamp + 1) + m_PageSize - 1) & ~(m_PageSize - 1);
+        uintptr_t purgeEnd = (reinterpret_cast<uintptr_t>(pBlock->GetNextBlock()) - sizeof(size_t)) & ~(m_PageSize - 1);
+        if (purgeEnd > purgeStart)
+        {
+            PurgeVirtualMemory(reinterpret_cast<void*>(purgeStart), purgeEnd - purgeStart);
+        }
+        *pStamp = s_PurgedStamp;
+    }
+}
 
-        if (pBlock->Next)
+// GetHandleEntry (nullptr for a handle that was never handed out or whose
+// allocation has been freed)
+HeapManager::HandleEntry* HeapManager::GetHandleEntry(HeapHandle handle)
+{
+    uint32_t slot = static_cast<uint32_t>(handle) - 1;
+    if (handle == s_InvalidHeapHandle || slot >= m_NumHandles || !m_pHandles[slot].Block ||
+        m_pHandles[slot].Generation != static_cast<uint32_t>(handle >> 32))
+    {
+        printf("HeapManager: invalid handle 0x%" PRIx64 "\n", handle);
+        return nullptr;
+    }
+    return &m_pHandles[slot];
+}
+
+// AllocRelocatable (an ordinary block with the index of its handle slot in
+// its first word; the slot is the only place its address is kept)
+HeapHandle HeapManager::AllocRelocatable(size_t Size)
+{
+    if (ExceedsHeap(Size))
+        return s_InvalidHeapHandle;
+
+    void* pPayload = alloc(Size + s_Granularity);
+    if (!pPayload)
+        return s_InvalidHeapHandle;
+
+    uint32_t slot = m_FirstFreeHandle;
+    if (slot != s_NoHandle)
+    {
+        m_FirstFreeHandle = m_pHandles[slot].PinCount;
+    }
+    else
+    {
+        if (m_NumHandles == m_HandleCapacity)
         {
-            pBlock->Next->Prev = pBlock;
+            uint32_t capacity = m_HandleCapacity ? 2 * m_HandleCapacity : s_InitialHandleCapacity;
+            void* pHandles = _aligned_realloc(m_pHandles, capacity * sizeof(HandleEntry), alignof(HandleEntry));
+            if (!pHandles)
+            {
+                printf("HeapManager::AllocRelocatable failed: Unable to grow the handle table to %u handles\n", capacity);
+                Free(pPayload);
+                return s_InvalidHeapHandle;
+            }
+            m_pHandles = static_cast<HandleEntry*>(pHandles);
+            m_HandleCapacity = capacity;
         }
+        slot = m_NumHandles++;
+        m_pHandles[slot].Generation = 0;
     }
 
-    // Merge with the previous block if it's free
-    if (pBlock->Prev && Contains(pBlock->Prev) && pBlock->Prev->IsFree)
+    MemoryBlock* pBlock = reinterpret_cast<MemoryBlock*>(pPayload) - 1;
+    pBlock->SetRelocatable(true);
+    *static_cast<size_t*>(pPayload) = slot;
+
+    HandleEntry& entry = m_pHandles[slot];
+    entry.Block = pBlock;
+    entry.PinCount = 0;
+    return (HeapHandle(entry.Generation) << 32) | (slot + 1);
+}
+
+// Pin (pins nest; the address stays valid until the last Unpin)
+void* HeapManager::Pin(HeapHandle handle)
+{
+    HandleEntry* pEntry = GetHandleEntry(handle);
+    if (!pEntry)
+        return nullptr;
+
+    ++pEntry->PinCount;
+    return reinterpret_cast<char*>(pEntry->Block + 1) + s_Granularity;
+}
+
+void HeapManager::Unpin(HeapHandle handle)
+{
+    HandleEntry* pEntry = GetHandleEntry(handle);
+    if (!pEntry)
+        return;
+
+    if (pEntry->PinCount == 0)
     {
-        pBlock->Prev->Size += sizeof(MemoryBlock) + pBlock->Size;
-        pBlock->Prev->Next = pBlock->Next;
+        printf("HeapManager::Unpin: handle 0x%" PRIx64 " is not pinned\n", handle);
+        return;
+    }
+    --pEntry->PinCount;
+}
+
+// FreeRelocatable (the slot's generation moves on, so the handle stops working)
+bool HeapManager::FreeRelocatable(HeapHandle handle)
+{
+    HandleEntry* pEntry = GetHandleEntry(handle);
+    if (!pEntry)
+        return false;
+
+    MemoryBlock* pBlock = pEntry->Block;
+    pBlock->SetRelocatable(false);
+    Free(pBlock + 1);
+
+    uint32_t slot = static_cast<uint32_t>(pEntry - m_pHandles);
+    pEntry->Block = nullptr;
+    ++pEntry->Generation;
+    pEntry->PinCount = m_FirstFreeHandle;
+    m_FirstFreeHandle = slot;
+    return true;
+}
+
+// IsMovable (an allocated relocatable block nobody has pinned)
+bool HeapManager::IsMovable(MemoryBlock* pBlock) const
+{
+    if (!pBlock->IsRelocatable())
+        return false;
+
+    size_t slot = *reinterpret_cast<size_t*>(pBlock + 1);
+    return m_pHandles[slot].PinCount == 0;
+}
+
+// SlideDown (moves a movable block to the start of the free block right
+// before it, so the free space ends up after it, merged with any free block
+// that follows; returns that free block)
+MemoryBlock* HeapManager::SlideDown(MemoryBlock* pBlock, MemoryBlock* pFreeBlock)
+{
+    size_t size = pBlock->GetSize();
+    size_t freeSize = pFreeBlock->GetSize();
+    bool prevFree = pFreeBlock->IsPrevFree();
+
+    RemoveFreeBlock(pFreeBlock);
+    memmove(pFreeBlock + 1, pBlock + 1, size);
+
+    MemoryBlock* pMoved = pFreeBlock;
+    pMoved->SizeAndFlags = size | MemoryBlock::s_RelocatableFlag;
+    pMoved->SetPrevFree(prevFree);
+    m_pHandles[*reinterpret_cast<size_t*>(pMoved + 1)].Block = pMoved;
+    RetargetCursors(pBlock, pMoved);
+
+    MemoryBlock* pNewFree = pMoved->GetNextBlock();
+    pNewFree->SizeAndFlags = freeSize;
+    pNewFree->SetFree(true);
+    pNewFree->WriteFooter();
+    pNewFree->GetNextBlock()->SetPrevFree(true);
 
-        if (pBlock->Next)
+    InsertFreeBlock(pNewFree);
+    return Coalesce(pNewFree);
+}
+
+// MoveIntoGap (moves a movable block to the start of a free block further
+// down the heap, splitting the rest of the gap off as a free block, and frees
+// the space it came from. Returns the rest of the gap, or nullptr if the block
+// filled it; o_Vacated is the free block its old space ended up in)
+MemoryBlock* HeapManager::MoveIntoGap(MemoryBlock* pBlock, MemoryBlock* pGap, MemoryBlock*& o_pVacated)
+{
+    size_t size = pBlock->GetSize();
+    size_t gapSize = pGap->GetSize();
+    bool prevFree = pGap->IsPrevFree();
+
+    RemoveFreeBlock(pGap);
+    memcpy(pGap + 1, pBlock + 1, size);
+
+    MemoryBlock* pMoved = pGap;
+    pMoved->SizeAndFlags = size | MemoryBlock::s_RelocatableFlag;
+    pMoved->SetPrevFree(prevFree);
+    m_pHandles[*reinterpret_cast<size_t*>(pMoved + 1)].Block = pMoved;
+
+    MemoryBlock* pRest = nullptr;
+    if (gapSize == size)
+    {
+        pMoved->GetNextBlock()->SetPrevFree(false);
+    }
+    else
+    {
+        pRest = pMoved->GetNextBlock();
+        pRest->SizeAndFlags = gapSize - size - sizeof(MemoryBlock);
+        pRest->SetFree(true);
+        pRest->WriteFooter();
+        InsertFreeBlock(pRest);
+    }
+
+    pBlock->SetRelocatable(false);
+    pBlock->SetFree(true);
+    pBlock->WriteFooter();
+    pBlock->GetNextBlock()->SetPrevFree(true);
+    InsertFreeBlock(pBlock);
+    o_pVacated = Coalesce(pBlock);
+    return pRest;
+}
+
+// FillGap (a free block that can't slide past the block after it: moves
+// movable blocks from past that one into it while they fit, until the gap is
+// full, the budget is spent or s_CompactLookahead blocks in a row didn't fit.
+// Each move counts against the budget. Returns the last block now in the
+// gap's space)
+MemoryBlock* HeapManager::FillGap(MemoryBlock* pGap, size_t& io_Visited, size_t BlockBudget)
+{
+    MemoryBlock* pLast = pGap;
+    MemoryBlock* pCandidate = pGap->GetNextBlock()->GetNextBlock();
+    size_t skipped = 0;
+    while (pGap && pCandidate->GetSize() != 0 && skipped < s_CompactLookahead && io_Visited < BlockBudget)
+    {
+        size_t size = pCandidate->GetSize();
+        size_t gapSize = pGap->GetSize();
+        if (!IsMovable(pCandidate) || (size != gapSize && gapSize < size + sizeof(MemoryBlock) + s_MinumumToLeave))
         {
-            pBlock->Next->Prev = pBlock->Prev;
+            pCandidate = pCandidate->GetNextBlock();
+            ++skipped;
+            continue;
         }
+
+        MemoryBlock* pMoved = pGap;
+        MemoryBlock* pVacated;
+        pGap = MoveIntoGap(pCandidate, pGap, pVacated);
+        pLast = pGap ? pGap : pMoved;
+        pCandidate = pVacated->GetNextBlock();
+        skipped = 0;
+        ++io_Visited;
     }
+    return pLast;
 }
 
-// SplitBlock (creates a new block if the free block is larger than requested size)
+// Compact (one whole pass from the start of the heap)
+void HeapManager::Compact()
+{
+    m_pCompactCursor = nullptr;
+    Compact(~size_t(0));
+}
+
+// Compact (budgeted: each free block met on the walk swaps places with the
+// movable blocks after it one at a time, carrying the free space up to the
+// next block that can't move, where FillGap takes over)
+bool HeapManager::Compact(size_t BlockBudget)
+{
+    if (!m_pFirstBlock)
+        return true;
+
+    MemoryBlock* pBlock = m_pCompactCursor ? m_pCompactCursor : m_pFirstBlock;
+    for (size_t visited = 0; visited < BlockBudget && pBlock->GetSize() != 0; ++visited)
+    {
+        if (pBlock->IsFree())
+        {
+            pBlock = Coalesce(pBlock);
+            MemoryBlock* pNext = pBlock->GetNextBlock();
+            if (IsMovable(pNext))
+            {
+                pBlock = SlideDown(pNext, pBlock);
+                continue;
+            }
+            if (pNext->GetSize() != 0)
+            {
+                pBlock = FillGap(pBlock, visited, BlockBudget);
+            }
+        }
+        pBlock = pBlock->GetNextBlock();
+    }
+    UpdateLargestFreeBlock();
+
+    if (pBlock->GetSize() != 0)
+    {
+        m_pCompactCursor = pBlock;
+        return false;
+    }
+    m_pCompactCursor = nullptr;
+    return true;
+}
+
+// Grow (OS-backed heaps only: commits more of the reservation and turns the
+// epilogue into a free block spanning it, merged with any free block before it)
+bool HeapManager::Grow(size_t MinFreeSize)
+{
+    if (!m_OwnsMemory || !m_pFirstBlock)
+        return false;
+
+    // The extra eighth lets TLSF, which rounds up to the next bin, use the new block
+    size_t growSize = MinFreeSize + MinFreeSize / 8 + 2 * sizeof(MemoryBlock);
+    growSize = (growSize + s_GrowGranularity - 1) & ~(s_GrowGranularity - 1);
+    growSize = std::min(growSize, m_ReservedSize - m_HeapSize);
+    if (growSize < sizeof(MemoryBlock) + s_MinumumToLeave)
+        return false;
+
+    char* pCommitStart = static_cast<char*>(m_pHeapMemory) + m_HeapSize;
+    if (!CommitVirtualMemory(pCommitStart, growSize))
+        return false;
+    m_HeapSize += growSize;
+
+    // The old epilogue header becomes the new block's header
+    MemoryBlock* pBlock = reinterpret_cast<MemoryBlock*>(pCommitStart) - 1;
+    pBlock->SetSize(growSize - sizeof(MemoryBlock));
+    pBlock->SetFree(true);
+    pBlock->WriteFooter();
+
+    MemoryBlock* pEpilogue = pBlock->GetNextBlock();
+    pEpilogue->SizeAndFlags = 0;
+    pEpilogue->SetPrevFree(true);
+
+    InsertFreeBlock(pBlock);
+    Coalesce(pBlock);
+    return true;
+}
+
+// Coalesce (merges adjacent free blocks into a single bigger block; the block
+// must already be in its free bin)
+MemoryBlock* HeapManager::Coalesce(MemoryBlock* pBlock)
+{
+    if (!Contains(pBlock) || !pBlock->IsFree())
+        return pBlock;
+
+    // Merge with the next block if it's free
+    MemoryBlock* pNext = pBlock->GetNextBlock();
+    if (pNext->IsFree())
+    {
+        RemoveFreeBlock(pNext);
+        RemoveFreeBlock(pBlock);
+        RetargetCursors(pNext, pBlock);
+
+        pBlock->SetSize(pBlock->GetSize() + sizeof(MemoryBlock) + pNext->GetSize());
+        pBlock->WriteFooter();
+
+        InsertFreeBlock(pBlock);
+    }
+
+    // Merge with the previous block if it's free
+    if (pBlock->IsPrevFree())
+    {
+        MemoryBlock* pPrev = pBlock->GetPrevBlock();
+        RemoveFreeBlock(pPrev);
+        RemoveFreeBlock(pBlock);
+        RetargetCursors(pBlock, pPrev);
+
+        pPrev->SetSize(pPrev->GetSize() + sizeof(MemoryBlock) + pBlock->GetSize());
+        pPrev->WriteFooter();
+
+        InsertFreeBlock(pPrev);
+        pBlock = pPrev;
+    }
+    return pBlock;
+}
+
+// SplitBlock (creates a new free block from the tail if the block is larger
+// than requested size; the block itself must not be in a free bin)
 void HeapManager::SplitBlock(MemoryBlock* pBlock, size_t requiredSize)
 {
-    if (pBlock->Size > requiredSize + sizeof(MemoryBlock) + s_MinumumToLeave)
+    if (pBlock->GetSize() >= requiredSize + sizeof(MemoryBlock) + s_MinumumToLeave)
     {
         MemoryBlock* pNewBlock = reinterpret_cast<MemoryBlock*>(
             reinterpret_cast<char*>(pBlock + 1) + requiredSize);
 
-        // Check if the new block pointer is valid and inside the heap
-        if (!Contains(pNewBlock) ||
-            reinterpret_cast<uintptr_t>(pNewBlock) >= reinterpret_cast<uintptr_t>(m_pHeapMemory) + m_HeapSize)
-        {
-            return; // Do not split if new block is out of heap bounds
-        }
-
-        pNewBlock->Size = pBlock->Size - requiredSize - sizeof(MemoryBlock);
-        pNewBlock->IsFree = true;
-        pNewBlock->Next = pBlock->Next;
-        pNewBlock->Prev = pBlock;
+        pNewBlock->SizeAndFlags = pBlock->GetSize() - requiredSize - sizeof(MemoryBlock);
+        pNewBlock->SetFree(true);
+        pNewBlock->SetPrevFree(pBlock->IsFree());
+        pNewBlock->WriteFooter();
+        pNewBlock->GetNextBlock()->SetPrevFree(true);
 
-        if (pBlock->Next)
+        pBlock->SetSize(requiredSize);
+        if (pBlock->IsFree())
         {
-            pBlock->Next->Prev = pNewBlock;
+            pBlock->WriteFooter();
         }
 
-        pBlock->Next = pNewBlock;
-        pBlock->Size = requiredSize;
+        InsertFreeBlock(pNewBlock);
     }
 }
 
@@ -1,36 +1,263 @@
 #pragma once
 
 #include "cstddef"
+#include "AllocatorStats.h"
+#include <atomic>
+#include <cstdint>
 
+// Boundary-tag block header. Headers sit 8 bytes below a 16-byte boundary and
+// payload sizes are 8 more than a multiple of 16, so every payload is 16-byte
+// aligned and the low bits of the header word hold the flags. Free blocks also
+// repeat their size in a footer (the last word of the payload) so the next
+// block can find them.
 struct MemoryBlock {
-    size_t Size;
-    bool IsFree;
-    MemoryBlock* Next;
-    MemoryBlock* Prev;
+    static const size_t s_FreeFlag = 1;
+    static const size_t s_PrevFreeFlag = 2;
+    static const size_t s_RelocatableFlag = 4;    // allocated through a handle, Compact may move it
+    static const size_t s_FlagMask = 7;
+
+    size_t SizeAndFlags;
+
+    size_t GetSize() const { return SizeAndFlags & ~s_FlagMask; }
+    bool IsFree() const { return (SizeAndFlags & s_FreeFlag) != 0; }
+    bool IsPrevFree() const { return (SizeAndFlags & s_PrevFreeFlag) != 0; }
+    bool IsRelocatable() const { return (SizeAndFlags & s_RelocatableFlag) != 0; }
+
+    void SetSize(size_t Size) { SizeAndFlags = Size | (SizeAndFlags & s_FlagMask); }
+    void SetFree(bool Free) { SizeAndFlags = Free ? (SizeAndFlags | s_FreeFlag) : (SizeAndFlags & ~s_FreeFlag); }
+    void SetPrevFree(bool Free) { SizeAndFlags = Free ? (SizeAndFlags | s_PrevFreeFlag) : (SizeAndFlags & ~s_PrevFreeFlag); }
+    void SetRelocatable(bool Relocatable) { SizeAndFlags = Relocatable ? (SizeAndFlags | s_RelocatableFlag) : (SizeAndFlags & ~s_RelocatableFlag); }
+
+    void WriteFooter() { *reinterpret_cast<size_t*>(reinterpret_cast<char*>(this + 1) + GetSize() - sizeof(size_t)) = GetSize(); }
+
+    // Physically adjacent blocks; GetPrevBlock is only valid when IsPrevFree()
+    MemoryBlock* GetNextBlock() { return reinterpret_cast<MemoryBlock*>(reinterpret_cast<char*>(this + 1) + GetSize()); }
+    MemoryBlock* GetPrevBlock()
+    {
+        size_t prevSize = *(reinterpret_cast<size_t*>(this) - 1);
+        return reinterpret_cast<MemoryBlock*>(reinterpret_cast<char*>(this) - prevSize - sizeof(MemoryBlock));
+    }
+};
+
+// Links for the segregated free lists, stored in the payload of free blocks
+struct FreeBlockLinks {
+    MemoryBlock* NextFree;
+    MemoryBlock* PrevFree;
+};
+
+// Relocatable allocations are named by a handle instead of an address: the
+// low 32 bits are the slot in the heap's handle table plus one, the high 32
+// bits the slot's generation, so a handle to a freed allocation is rejected
+typedef uint64_t HeapHandle;
+static const HeapHandle s_InvalidHeapHandle = 0;
+
+// Free space of a heap, kept up to date as blocks are split, allocated, freed
+// and coalesced. Bucket i of the histogram counts free blocks whose payload is
+// in [2^i, 2^(i+1)).
+struct FreeSpaceStats {
+    static const size_t s_NumSizeBuckets = sizeof(size_t) * 8;
+
+    size_t FreeBytes;           // payload bytes of free blocks
+    size_t FreeBlockCount;
+    size_t LargestFreeBlock;
+    size_t FreeBlockHistogram[s_NumSizeBuckets];
+
+    // 0 when all free space is one block, approaching 1 as it is scattered
+    // over many small ones
+    double GetExternalFragmentation() const { return FreeBytes ? 1.0 - double(LargestFreeBlock) / double(FreeBytes) : 0.0; }
+};
+
+// Free block search policy
+enum class HeapEngine {
+    SegregatedFit,  // first fit inside the request's bin, then the next non-empty bin
+    TLSF            // two-level segregated fit: rounds the request up to a bin that always fits, O(1) worst case
 };
 
 class HeapManager
 {
 private:
+    // Payloads are aligned to s_Granularity. Sizes below s_LinearBinLimit get
+    // one bin per s_Granularity bytes, larger sizes get s_SubBinCount bins per
+    // power of two.
+    static const size_t s_Granularity = 16;
+    static const size_t s_LinearBinLimit = 128;
+    static const unsigned int s_SubBinBits = 3;
+    static const size_t s_SubBinCount = size_t(1) << s_SubBinBits;
+    static const unsigned int s_LinearBinLimitLog2 = 7;
+    static const size_t s_NumLinearBins = s_LinearBinLimit / s_Granularity;
+    static const size_t s_NumBins = s_NumLinearBins + (sizeof(size_t) * 8 - s_LinearBinLimitLog2) * s_SubBinCount;
+    static const size_t s_NumBitmapWords = (s_NumBins + 63) / 64;
+
+    // OS-backed heaps commit in steps of s_GrowGranularity, and Collect purges
+    // the pages inside free blocks nothing has touched for s_PurgeIdleCollects
+    // collections. Free blocks big enough to purge keep the collection count
+    // at which they were last changed just after their links.
+    static const size_t s_GrowGranularity = 64 * 1024;
+    static const size_t s_PurgeIdleCollects = 2;
+    static const size_t s_PurgedStamp = ~size_t(0);
+
+    // With deferred coalescing, an allocation that finds no fit merges free
+    // blocks this many at a time, checking for a fit in between
+    static const size_t s_FitCoalesceBudget = 256;
+
+    // SegregatedFit looks at this many blocks too small for a request before
+    // taking the head of a bin that is guaranteed to fit instead
+    static const size_t s_FirstFitScanLimit = 8;
+
+    // Handle table slot. A relocatable block starts with the index of its
+    // slot, padded to s_Granularity so the caller's data that follows stays
+    // aligned. Free slots have no block and keep the
+    // index of the next free slot in PinCount.
+    struct HandleEntry {
+        MemoryBlock* Block;
+        uint32_t PinCount;
+        uint32_t Generation;
+    };
+    static const uint32_t s_NoHandle = ~uint32_t(0);
+    static const uint32_t s_InitialHandleCapacity = 64;
+
+    // How many blocks past one that can't move Compact passes over, without
+    // finding one that fits, while filling the free space stuck in front of it
+    static const size_t s_CompactLookahead = 64;
+
     void* m_pHeapMemory;
-    size_t m_HeapSize;
-    MemoryBlock* m_FreeList;
+    size_t m_HeapSize;          // committed bytes; only grows for OS-backed heaps
+    size_t m_ReservedSize;      // address space owned by the heap, Contains checks against it
+    MemoryBlock* m_pFirstBlock;
+    HeapEngine m_Engine;
+    bool m_OwnsMemory;
+    size_t m_PageSize;
+    size_t m_PurgeMinSize;      // smallest free payload that can hold a whole page to purge, ~0 when purging is off
+    size_t m_CollectCount;
+
+    // Collect walks the heap a budget of blocks at a time, resuming at
+    // m_pCollectCursor (nullptr between passes). Blocks merged into their
+    // previous block move the cursor to it.
+    MemoryBlock* m_pCollectCursor;
+    bool m_DeferCoalescing;     // Free leaves blocks unmerged until a fit fails or Collect
+    size_t m_DeferredFrees;     // frees left unmerged since the current pass started
+    size_t m_DeferredFreesAtPassStart;
+
+    // Compact slides unpinned relocatable blocks down into the free space
+    // before them, a budget of blocks at a time from m_pCompactCursor
+    MemoryBlock* m_pCompactCursor;
+    HandleEntry* m_pHandles;
+    uint32_t m_NumHandles;
+    uint32_t m_HandleCapacity;
+    uint32_t m_FirstFreeHandle;
+    AllocatorStats m_Stats;     // payload bytes of allocated blocks
+
+    // Free space counters, updated in InsertFreeBlock/RemoveFreeBlock. Only
+    // the thread using the heap writes them, so any thread can read them
+    // without a lock. m_NumLargestFreeBlocks counts the free blocks of the
+    // largest size; removing the last of them leaves m_LargestFreeBlock stale
+    // until the end of the operation, when it is found again in the highest
+    // non-empty bin unless a block at least as big was freed in the meantime.
+    std::atomic<size_t> m_FreeBytes;
+    std::atomic<size_t> m_FreeBlockCount;
+    std::atomic<size_t> m_LargestFreeBlock;
+    std::atomic<size_t> m_FreeBlockHistogram[FreeSpaceStats::s_NumSizeBuckets];
+    size_t m_NumLargestFreeBlocks;
+    bool m_LargestFreeBlockStale;
+
+    MemoryBlock* m_FreeBins[s_NumBins];
+    uint64_t m_BinBitmap[s_NumBitmapWords];
+    uint64_t m_BinBitmapSummary;
+
+    static size_t RoundSize(size_t Size);
+    // No block can be bigger than the reservation, and rejecting such sizes
+    // up front keeps RoundSize and the fit arithmetic from wrapping
+    bool ExceedsHeap(size_t Size) const { return Size > m_ReservedSize; }
+    static size_t GetBinIndex(size_t Size);
+    static size_t GetBinLowerBound(size_t Bin);
+    static FreeBlockLinks* GetLinks(MemoryBlock* Block);
+    static size_t* GetFreeStamp(MemoryBlock* Block);
+
+    void Initialize(void* HeapMemory, size_t HeapSize);
+    bool Grow(size_t MinFreeSize);
+    void PurgeIdleBlock(MemoryBlock* Block);
+    bool CollectStep(size_t BlockBudget, bool Purge);
+    MemoryBlock* CoalesceForFit(size_t Size, size_t Alignment);
+    void RetargetCursors(MemoryBlock* From, MemoryBlock* To);
+    HandleEntry* GetHandleEntry(HeapHandle Handle);
+    bool IsMovable(MemoryBlock* Block) const;
+    MemoryBlock* SlideDown(MemoryBlock* Block, MemoryBlock* FreeBlock);
+    MemoryBlock* MoveIntoGap(MemoryBlock* Block, MemoryBlock* Gap, MemoryBlock*& o_Vacated);
+    MemoryBlock* FillGap(MemoryBlock* Gap, size_t& io_Visited, size_t BlockBudget);
+
+    void MarkAllocated(MemoryBlock* Block);
+    void InsertFreeBlock(MemoryBlock* Block);
+    void RemoveFreeBlock(MemoryBlock* Block);
+    bool FindNonEmptyBin(size_t FirstBin, size_t& o_Bin) const;
+    void UpdateLargestFreeBlock();
+    MemoryBlock* FindFreeBlock(size_t Size, size_t Alignment);
 
 public:
-    static const size_t s_MinumumToLeave = 16;
+    // Smallest payload: a free block must hold its links and its footer
+    static const size_t s_MinumumToLeave = sizeof(FreeBlockLinks) + sizeof(size_t);
 
-    HeapManager(void* HeapMemory, size_t HeapSize, size_t NumDescriptors);
+    HeapManager(void* HeapMemory, size_t HeapSize, size_t NumDescriptors, HeapEngine Engine = HeapEngine::SegregatedFit);
+    // OS-backed heap: reserves ReserveSize bytes of address space, commits
+    // InitialSize of it and grows on demand
+    HeapManager(size_t ReserveSize, size_t InitialSize, HeapEngine Engine = HeapEngine::SegregatedFit);
+    ~HeapManager();
+
+    HeapManager(const HeapManager&) = delete;
+    HeapManager& operator=(const HeapManager&) = delete;
+
+    void* GetHeapMemory() const { return m_pHeapMemory; }
+    size_t GetCommittedSize() const { return m_HeapSize; }
+    size_t GetReservedSize() const { return m_ReservedSize; }
+    HeapEngine GetEngine() const { return m_Engine; }
+    AllocatorStats GetStats() const { return m_Stats; }
+    // Safe to call from any thread while the heap is in use; the fields are
+    // read one at a time, so they may be from either side of an operation
+    FreeSpaceStats GetFreeSpaceStats() const;
     void* alloc(size_t Size);
     void* alloc(size_t Size, unsigned int Alignment);
+    // alloc without the failure messages, for callers that expect to run out
+    // and have somewhere else to go
+    void* TryAlloc(size_t Size, unsigned int Alignment);
+    // Allocates Count blocks of Size bytes, carving runs of them out of one
+    // free block at a time; returns how many it allocated
+    size_t AllocBatch(size_t Size, size_t Count, void** o_ptrs);
+    void FreeBatch(void** ptrs, size_t Count);
+    // Resizes in place when the block shrinks or the next block is free,
+    // otherwise moves it; nullptr on failure with ptr still valid
+    void* Realloc(void* ptr, size_t Size);
     void* Alignment(void* Address, unsigned int Alignment, size_t& Padding);
     void SplitBlock(MemoryBlock* Block, size_t Size);
     void DisplayHeap();
+    // Collect walks the whole heap in one go; the budgeted version visits at
+    // most BlockBudget blocks per call, picking up where the last call stopped,
+    // and returns true when it completes a pass. Both merge free neighbours
+    // and purge idle pages.
     void Collect();
+    bool Collect(size_t BlockBudget);
+    // Relocatable allocations, for heaps that Compact. The block may move
+    // whenever it isn't pinned; Pin returns its current address and keeps it
+    // there until the matching Unpin. Only FreeRelocatable may free them.
+    HeapHandle AllocRelocatable(size_t Size);
+    void* Pin(HeapHandle Handle);
+    void Unpin(HeapHandle Handle);
+    bool FreeRelocatable(HeapHandle Handle);
+    // Compact slides every unpinned relocatable block as far down as the
+    // pinned and ordinary blocks allow, and fills the free space left in
+    // front of those with movable blocks from just past them, so free space
+    // gathers at the top of the heap. Like Collect, the budgeted version
+    // resumes where the last call stopped and returns true once it completes a pass.
+    void Compact();
+    bool Compact(size_t BlockBudget);
+    // Off by default: Free merges with free neighbours right away
+    void SetDeferredCoalescing(bool Defer) { m_DeferCoalescing = Defer; }
+    bool IsCoalescingDeferred() const { return m_DeferCoalescing; }
     bool Free(void* ptr);
-    void Coalesce(MemoryBlock* Block);
-    size_t GetLargestFreeBlock();
+    // Returns the block that Block ended up in
+    MemoryBlock* Coalesce(MemoryBlock* Block);
+    size_t GetLargestFreeBlock() const { return m_LargestFreeBlock.load(std::memory_order_relaxed); }
     bool Contains(void* ptr);
     bool IsAllocated(void* ptr);
+    size_t GetAllocationSize(void* ptr);
     void ShowFreeBlocks();
     void ShowOutstandingAllocations();
-};
\ No newline at end of file
+};
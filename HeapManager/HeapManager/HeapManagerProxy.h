@@ -5,9 +5,9 @@
 
 namespace HeapManagerProxy 
 {
-    HeapManager* CreateHeapManager(void* HeapMemory, size_t HeapSize, size_t numDescriptors) 
+    HeapManager* CreateHeapManager(void* HeapMemory, size_t HeapSize, size_t numDescriptors, HeapEngine Engine = HeapEngine::SegregatedFit) 
     {
-        return new HeapManager(HeapMemory, HeapSize, numDescriptors);
+        return new HeapManager(HeapMemory, HeapSize, numDescriptors, Engine);
     }
 
     void Destroy(HeapManager* pHeapManager) 
@@ -25,6 +25,21 @@ namespace HeapManagerProxy
         return pHeapManager->alloc(Size, Alignment);
     }
 
+    size_t AllocBatch(HeapManager* pHeapManager, size_t Size, size_t Count, void** ptrs) 
+    {
+        return pHeapManager->AllocBatch(Size, Count, ptrs);
+    }
+
+    void FreeBatch(HeapManager* pHeapManager, void** ptrs, size_t Count) 
+    {
+        pHeapManager->FreeBatch(ptrs, Count);
+    }
+
+    void* Realloc(HeapManager* pHeapManager, void* ptr, size_t Size) 
+    {
+        return pHeapManager->Realloc(ptr, Size);
+    }
+
     bool free(HeapManager* pHeapManager, void* ptr) 
     {
         return pHeapManager->Free(ptr);
@@ -35,6 +50,41 @@ namespace HeapManagerProxy
         pHeapManager->Collect();
     }
 
+    bool collect(HeapManager* pHeapManager, size_t BlockBudget) 
+    {
+        return pHeapManager->Collect(BlockBudget);
+    }
+
+    HeapHandle AllocRelocatable(HeapManager* pHeapManager, size_t Size) 
+    {
+        return pHeapManager->AllocRelocatable(Size);
+    }
+
+    void* Pin(HeapManager* pHeapManager, HeapHandle Handle) 
+    {
+        return pHeapManager->Pin(Handle);
+    }
+
+    void Unpin(HeapManager* pHeapManager, HeapHandle Handle) 
+    {
+        pHeapManager->Unpin(Handle);
+    }
+
+    bool FreeRelocatable(HeapManager* pHeapManager, HeapHandle Handle) 
+    {
+        return pHeapManager->FreeRelocatable(Handle);
+    }
+
+    void compact(HeapManager* pHeapManager) 
+    {
+        pHeapManager->Compact();
+    }
+
+    bool compact(HeapManager* pHeapManager, size_t BlockBudget) 
+    {
+        return pHeapManager->Compact(BlockBudget);
+    }
+
     size_t GetLargestFreeBlock(HeapManager* pHeapManager) 
     {
         return pHeapManager->GetLargestFreeBlock();
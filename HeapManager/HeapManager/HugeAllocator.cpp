@@ -0,0 +1,200 @@
+#include "HugeAllocator.h"
+#include "VirtualMemory.h"
+#include <cstring>
+
+HugeAllocator::HugeAllocator(PageMap& pageMap, std::mutex& pageMapMutex, size_t threshold)
+    : m_PageMap(pageMap), m_PageMapMutex(pageMapMutex), m_PageSize(GetVirtualPageSize()),
+    m_Threshold(threshold), m_NumAllocations(0), m_MappedBytes(0), m_PeakMappedBytes(0), m_AllocCount(0), m_FreeCount(0),
+    m_CachedMappings(), m_NumCachedMappings(0), m_CachedBytes(0)
+{
+}
+
+// Adds to the mapped bytes (a wrapped-around value subtracts) and raises the peak
+void HugeAllocator::AddMappedBytes(size_t bytes)
+{
+    size_t mappedBytes = m_MappedBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    size_t peak = m_PeakMappedBytes.load(std::memory_order_relaxed);
+    while (mappedBytes > peak && !m_PeakMappedBytes.compare_exchange_weak(peak, mappedBytes, std::memory_order_relaxed))
+    {
+    }
+}
+
+AllocatorStats HugeAllocator::GetStats() const
+{
+    AllocatorStats stats;
+    stats.BytesInUse = m_MappedBytes.load(std::memory_order_relaxed);
+    stats.PeakBytesInUse = m_PeakMappedBytes.load(std::memory_order_relaxed);
+    stats.AllocCount = m_AllocCount.load(std::memory_order_relaxed);
+    stats.FreeCount = m_FreeCount.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void HugeAllocator::Register(void* pMapping)
+{
+    std::lock_guard<std::mutex> lock(m_PageMapMutex);
+    m_PageMap.SetRange(pMapping, s_HeaderSize, PageOwner{ PageOwnerKind::HugeAllocation, 0 });
+}
+
+void HugeAllocator::Unregister(void* pMapping)
+{
+    std::lock_guard<std::mutex> lock(m_PageMapMutex);
+    m_PageMap.ClearRange(pMapping, s_HeaderSize);
+}
+
+// Removes the smallest cached mapping of at least i_MappedSize bytes and at
+// most a quarter more, so a reused mapping never wastes much; nullptr if none fits
+void* HugeAllocator::TakeCachedMapping(size_t mappedSize)
+{
+    std::lock_guard<std::mutex> lock(m_CacheMutex);
+    size_t bestIndex = m_NumCachedMappings;
+    size_t bestSize = mappedSize + mappedSize / 4 + 1;
+    for (size_t i = 0; i < m_NumCachedMappings; ++i)
+    {
+        size_t cachedSize = GetMappedSize(m_CachedMappings[i]);
+        if (cachedSize >= mappedSize && cachedSize < bestSize)
+        {
+            bestIndex = i;
+            bestSize = cachedSize;
+        }
+    }
+    if (bestIndex == m_NumCachedMappings)
+        return nullptr;
+
+    void* pMapping = m_CachedMappings[bestIndex];
+    memmove(&m_CachedMappings[bestIndex], &m_CachedMappings[bestIndex + 1], (m_NumCachedMappings - bestIndex - 1) * sizeof(void*));
+    --m_NumCachedMappings;
+    m_CachedBytes -= bestSize;
+    return pMapping;
+}
+
+// Keeps a freed mapping for reuse, unmapping the oldest ones to make room.
+// A mapping bigger than the whole cache is unmapped straight away.
+void HugeAllocator::CacheMapping(void* pMapping)
+{
+    size_t mappedSize = GetMappedSize(pMapping);
+    if (mappedSize > s_MaxCachedBytes)
+    {
+        ReleaseVirtualMemory(pMapping, mappedSize);
+        return;
+    }
+
+    void* pEvicted[s_MaxCachedMappings];
+    size_t numEvicted = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_CacheMutex);
+        while (m_NumCachedMappings == s_MaxCachedMappings || m_CachedBytes + mappedSize > s_MaxCachedBytes)
+        {
+            pEvicted[numEvicted++] = m_CachedMappings[0];
+            m_CachedBytes -= GetMappedSize(m_CachedMappings[0]);
+            --m_NumCachedMappings;
+            memmove(&m_CachedMappings[0], &m_CachedMappings[1], m_NumCachedMappings * sizeof(void*));
+        }
+        m_CachedMappings[m_NumCachedMappings++] = pMapping;
+        m_CachedBytes += mappedSize;
+    }
+
+    // Unmapped outside the lock
+    for (size_t i = 0; i < numEvicted; ++i)
+    {
+        ReleaseVirtualMemory(pEvicted[i], GetMappedSize(pEvicted[i]));
+    }
+}
+
+void HugeAllocator::ReleaseCachedMappings()
+{
+    void* pReleased[s_MaxCachedMappings];
+    size_t numReleased;
+    {
+        std::lock_guard<std::mutex> lock(m_CacheMutex);
+        numReleased = m_NumCachedMappings;
+        memcpy(pReleased, m_CachedMappings, numReleased * sizeof(void*));
+        m_NumCachedMappings = 0;
+        m_CachedBytes = 0;
+    }
+
+    for (size_t i = 0; i < numReleased; ++i)
+    {
+        ReleaseVirtualMemory(pReleased[i], GetMappedSize(pReleased[i]));
+    }
+}
+
+size_t HugeAllocator::GetCachedBytes()
+{
+    std::lock_guard<std::mutex> lock(m_CacheMutex);
+    return m_CachedBytes;
+}
+
+void* HugeAllocator::alloc(size_t size, bool zeroed)
+{
+    size_t mappedSize = GetMappingSize(size);
+    if (mappedSize < size)
+        return nullptr;     // overflowed
+
+    void* pMapping = TakeCachedMapping(mappedSize);
+    if (pMapping)
+    {
+        mappedSize = GetMappedSize(pMapping);
+        if (zeroed)
+        {
+            memset(static_cast<char*>(pMapping) + s_HeaderSize, 0, mappedSize - s_HeaderSize);
+        }
+    }
+    else
+    {
+        pMapping = MapVirtualMemory(mappedSize);
+        if (!pMapping)
+            return nullptr;
+        GetMappedSize(pMapping) = mappedSize;
+    }
+
+    Register(pMapping);
+    m_NumAllocations.fetch_add(1, std::memory_order_relaxed);
+    m_AllocCount.fetch_add(1, std::memory_order_relaxed);
+    AddMappedBytes(mappedSize);
+    return static_cast<char*>(pMapping) + s_HeaderSize;
+}
+
+void HugeAllocator::free(void* ptr)
+{
+    void* pMapping = GetMapping(ptr);
+    size_t mappedSize = GetMappedSize(pMapping);
+
+    // Forget the mapping before the OS can hand its address to someone else
+    Unregister(pMapping);
+    m_NumAllocations.fetch_sub(1, std::memory_order_relaxed);
+    m_FreeCount.fetch_add(1, std::memory_order_relaxed);
+    m_MappedBytes.fetch_sub(mappedSize, std::memory_order_relaxed);
+    CacheMapping(pMapping);
+}
+
+void* HugeAllocator::realloc(void* ptr, size_t size)
+{
+    void* pMapping = GetMapping(ptr);
+    size_t oldMappedSize = GetMappedSize(pMapping);
+    size_t newMappedSize = GetMappingSize(size);
+    if (newMappedSize < size)
+        return nullptr;
+    if (newMappedSize == oldMappedSize)
+        return ptr;
+
+    // Forget the old range first: once mremap moves the pages, the OS can hand
+    // that address to another thread's mapping before this one registers its new one
+    Unregister(pMapping);
+    void* pNewMapping = RemapVirtualMemory(pMapping, oldMappedSize, newMappedSize);
+    if (!pNewMapping)
+    {
+        // No remapping on this OS (or no room for it): copy into a new mapping
+        Register(pMapping);
+        void* pNew = alloc(size);
+        if (!pNew)
+            return nullptr;
+        memcpy(pNew, ptr, (oldMappedSize < newMappedSize ? oldMappedSize : newMappedSize) - s_HeaderSize);
+        free(ptr);
+        return pNew;
+    }
+
+    GetMappedSize(pNewMapping) = newMappedSize;
+    Register(pNewMapping);
+    AddMappedBytes(newMappedSize - oldMappedSize);
+    return static_cast<char*>(pNewMapping) + s_HeaderSize;
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include "AllocatorStats.h"
+#include "PageMap.h"
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+
+// Allocations at or above a threshold, each in its own OS mapping so they
+// never split the heap's free space. They aren't tracked in any block list:
+// a small header at the start of the mapping holds its size, and only the
+// mapping's first page is recorded in the page map, which is all free needs
+// to find it. realloc resizes the mapping with mremap where the OS has it, so
+// a growing buffer moves pages instead of copying bytes. Freed mappings are
+// kept in a small cache, oldest out first, for the next allocation of about
+// their size, since a buffer freed and allocated again each frame would
+// otherwise pay for an mmap, a munmap and faulting every page back in.
+// Thread-safe; page map updates are serialized with i_PageMapMutex.
+class HugeAllocator
+{
+public:
+    static const size_t s_DefaultThreshold = 256 * 1024;
+    static const size_t s_HeaderSize = 16;     // keeps the returned pointer 16-byte aligned
+    static const size_t s_MaxCachedMappings = 8;
+    static const size_t s_MaxCachedBytes = 16 * 1024 * 1024;
+
+private:
+    PageMap& m_PageMap;
+    std::mutex& m_PageMapMutex;
+    size_t m_PageSize;
+    std::atomic<size_t> m_Threshold;
+    std::atomic<size_t> m_NumAllocations;
+    std::atomic<size_t> m_MappedBytes;
+    std::atomic<size_t> m_PeakMappedBytes;
+    std::atomic<uint64_t> m_AllocCount;
+    std::atomic<uint64_t> m_FreeCount;
+
+    // Oldest first; each mapping's header still holds its size
+    std::mutex m_CacheMutex;
+    void* m_CachedMappings[s_MaxCachedMappings];
+    size_t m_NumCachedMappings;
+    size_t m_CachedBytes;
+
+    static size_t& GetMappedSize(void* i_pMapping) { return *static_cast<size_t*>(i_pMapping); }
+    static void* GetMapping(void* ptr) { return static_cast<char*>(ptr) - s_HeaderSize; }
+
+    size_t GetMappingSize(size_t i_Size) const { return (i_Size + s_HeaderSize + m_PageSize - 1) & ~(m_PageSize - 1); }
+    void AddMappedBytes(size_t i_Bytes);
+    void Register(void* i_pMapping);
+    void Unregister(void* i_pMapping);
+    void* TakeCachedMapping(size_t i_MappedSize);
+    void CacheMapping(void* i_pMapping);
+
+public:
+    HugeAllocator(PageMap& i_PageMap, std::mutex& i_PageMapMutex, size_t i_Threshold = s_DefaultThreshold);
+
+    HugeAllocator(const HugeAllocator&) = delete;
+    HugeAllocator& operator=(const HugeAllocator&) = delete;
+
+    // A reused mapping still holds what was last written to it, so i_Zeroed
+    // asks for it to be cleared; fresh mappings come zeroed from the OS
+    void* alloc(size_t i_Size, bool i_Zeroed = false);
+    void free(void* ptr);
+
+    // Unmaps the freed mappings kept for reuse
+    void ReleaseCachedMappings();
+
+    // Resizes a huge allocation, whatever the new size; nullptr on failure
+    // with ptr still valid
+    void* realloc(void* ptr, size_t i_Size);
+
+    // Usable bytes, including the rounding up to whole pages
+    size_t GetAllocationSize(void* ptr) const { return GetMappedSize(GetMapping(ptr)) - s_HeaderSize; }
+
+    bool IsHuge(size_t i_Size) const { return i_Size >= m_Threshold.load(std::memory_order_relaxed); }
+    size_t GetThreshold() const { return m_Threshold.load(std::memory_order_relaxed); }
+    void SetThreshold(size_t i_Threshold) { m_Threshold.store(i_Threshold, std::memory_order_relaxed); }
+
+    size_t GetNumAllocations() const { return m_NumAllocations.load(std::memory_order_relaxed); }
+    size_t GetMappedBytes() const { return m_MappedBytes.load(std::memory_order_relaxed); }
+    size_t GetCachedBytes();
+
+    // BytesInUse counts the whole mapped pages of live allocations, not the cache
+    AllocatorStats GetStats() const;
+};
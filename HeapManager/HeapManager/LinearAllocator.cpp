@@ -0,0 +1,72 @@
+#include "LinearAllocator.h"
+#include "HeapManager.h"
+#include <algorithm>
+
+LinearAllocator::LinearAllocator(HeapManager& heapManager, size_t chunkSize)
+    : m_HeapManager(heapManager), m_ChunkSize(chunkSize), m_pFirstChunk(nullptr), m_pCurrentChunk(nullptr),
+    m_pTop(nullptr), m_pEnd(nullptr), m_ChunkBytes(0)
+{
+}
+
+LinearAllocator::~LinearAllocator()
+{
+    Release();
+}
+
+// Moves on to the first chunk past the current one with room for the request,
+// splicing it in right after the current chunk, or carves a new chunk from the
+// heap there when none of them is big enough
+void* LinearAllocator::AllocFromNextChunk(size_t size, unsigned int alignment)
+{
+    if (size > m_HeapManager.GetReservedSize())
+        return nullptr;
+
+    size_t worstCaseSize = size + alignment - 1;
+    Chunk** ppLink = m_pCurrentChunk ? &m_pCurrentChunk->m_pNext : &m_pFirstChunk;
+    Chunk** ppFit = ppLink;
+    while (*ppFit && static_cast<size_t>((*ppFit)->m_pEnd - (*ppFit)->GetStart()) < worstCaseSize)
+    {
+        ppFit = &(*ppFit)->m_pNext;
+    }
+
+    Chunk* pNext = *ppFit;
+    if (pNext)
+    {
+        *ppFit = pNext->m_pNext;
+    }
+    else
+    {
+        void* pMemory = m_HeapManager.alloc(std::max(m_ChunkSize, sizeof(Chunk) + worstCaseSize));
+        if (!pMemory)
+            return nullptr;
+
+        size_t chunkSize = m_HeapManager.GetAllocationSize(pMemory);
+        pNext = static_cast<Chunk*>(pMemory);
+        pNext->m_pEnd = static_cast<char*>(pMemory) + chunkSize;
+        m_ChunkBytes += chunkSize;
+    }
+    pNext->m_pNext = *ppLink;
+    *ppLink = pNext;
+
+    m_pCurrentChunk = pNext;
+    m_pTop = pNext->GetStart();
+    m_pEnd = pNext->m_pEnd;
+    return alloc(size, alignment);
+}
+
+void LinearAllocator::Release()
+{
+    Chunk* pChunk = m_pFirstChunk;
+    while (pChunk)
+    {
+        Chunk* pNext = pChunk->m_pNext;
+        m_HeapManager.Free(pChunk);
+        pChunk = pNext;
+    }
+
+    m_pFirstChunk = nullptr;
+    m_pCurrentChunk = nullptr;
+    m_pTop = nullptr;
+    m_pEnd = nullptr;
+    m_ChunkBytes = 0;
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+class HeapManager;
+
+// Bump-pointer scratch memory for objects that die together. Memory comes in
+// chunks carved from a HeapManager, s_DefaultChunkSize bytes unless a request
+// needs more. Nothing is freed on its own: FreeToMarker and Reset move the top
+// back, and the chunks past it stay with the allocator for the next round, so
+// a steady per-frame workload stops calling the heap after its first frame.
+// Release hands the chunks back. No destructors are run. Not thread-safe.
+class LinearAllocator
+{
+public:
+    static const size_t s_DefaultChunkSize = 64 * 1024;
+    static const unsigned int s_DefaultAlignment = 16;
+
+private:
+    // Chunks form a list in the order they are filled; the ones past the
+    // current chunk are empty and kept for reuse
+    struct Chunk {
+        Chunk* m_pNext;
+        char* m_pEnd;
+
+        char* GetStart() { return reinterpret_cast<char*>(this + 1); }
+    };
+
+    HeapManager& m_HeapManager;
+    size_t m_ChunkSize;
+    Chunk* m_pFirstChunk;
+    Chunk* m_pCurrentChunk;     // nullptr until the first allocation or after Reset of an empty allocator
+    char* m_pTop;
+    char* m_pEnd;
+    size_t m_ChunkBytes;
+
+    void* AllocFromNextChunk(size_t i_Size, unsigned int i_Alignment);
+
+public:
+    // Everything allocated after GetMarker, freed with one FreeToMarker
+    struct Marker {
+        Chunk* pChunk;
+        char* pTop;
+    };
+
+    LinearAllocator(HeapManager& i_HeapManager, size_t i_ChunkSize = s_DefaultChunkSize);
+    ~LinearAllocator();
+
+    LinearAllocator(const LinearAllocator&) = delete;
+    LinearAllocator& operator=(const LinearAllocator&) = delete;
+
+    // i_Alignment must be a power of two; nullptr when the heap has no room for a new chunk
+    void* alloc(size_t i_Size, unsigned int i_Alignment = s_DefaultAlignment)
+    {
+        char* pAligned = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(m_pTop) + i_Alignment - 1) & ~uintptr_t(i_Alignment - 1));
+        if (m_pTop && pAligned <= m_pEnd && i_Size <= static_cast<size_t>(m_pEnd - pAligned))
+        {
+            m_pTop = pAligned + i_Size;
+            return pAligned;
+        }
+        return AllocFromNextChunk(i_Size, i_Alignment);
+    }
+
+    Marker GetMarker() const { return Marker{ m_pCurrentChunk, m_pTop }; }
+    // Frees everything allocated since i_Marker was taken; markers taken after
+    // it must not be used again
+    void FreeToMarker(const Marker& i_Marker)
+    {
+        m_pCurrentChunk = i_Marker.pChunk;
+        m_pTop = i_Marker.pTop;
+        m_pEnd = i_Marker.pChunk ? i_Marker.pChunk->m_pEnd : nullptr;
+    }
+    // Frees everything, keeping the chunks
+    void Reset() { FreeToMarker(Marker{ m_pFirstChunk, m_pFirstChunk ? m_pFirstChunk->GetStart() : nullptr }); }
+    // Frees everything and returns the chunks to the heap
+    void Release();
+
+    // Heap bytes held in chunks, used or not
+    size_t GetChunkBytes() const { return m_ChunkBytes; }
+};
+
+// Two LinearAllocators used on alternate frames, for data that has to live
+// through the frame after the one that made it. SwapBuffers starts a frame:
+// it resets the buffer filled two frames ago and allocates from it.
+class DoubleBufferedAllocator
+{
+private:
+    LinearAllocator m_Buffers[2];
+    unsigned int m_Current;
+
+public:
+    DoubleBufferedAllocator(HeapManager& i_HeapManager, size_t i_ChunkSize = LinearAllocator::s_DefaultChunkSize)
+        : m_Buffers{ LinearAllocator(i_HeapManager, i_ChunkSize), LinearAllocator(i_HeapManager, i_ChunkSize) }, m_Current(0)
+    {
+    }
+
+    void* alloc(size_t i_Size, unsigned int i_Alignment = LinearAllocator::s_DefaultAlignment) { return m_Buffers[m_Current].alloc(i_Size, i_Alignment); }
+
+    void SwapBuffers()
+    {
+        m_Current ^= 1;
+        m_Buffers[m_Current].Reset();
+    }
+
+    LinearAllocator& GetCurrentBuffer() { return m_Buffers[m_Current]; }
+    LinearAllocator& GetPreviousBuffer() { return m_Buffers[m_Current ^ 1]; }
+    void Release()
+    {
+        m_Buffers[0].Release();
+        m_Buffers[1].Release();
+    }
+};
@@ -0,0 +1,165 @@
+#include "MemoryResources.h"
+#include "HeapArena.h"
+#include "HeapManager.h"
+#include "LinearAllocator.h"
+#include <new>
+
+void* HeapManagerResource::do_allocate(size_t bytes, size_t alignment)
+{
+    void* ptr = m_HeapManager.alloc(bytes, static_cast<unsigned int>(alignment));
+    if (!ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void HeapManagerResource::do_deallocate(void* ptr, size_t, size_t)
+{
+    m_HeapManager.Free(ptr);
+}
+
+void* HeapArenaResource::do_allocate(size_t bytes, size_t alignment)
+{
+    void* ptr = m_Arena.alloc(bytes, static_cast<unsigned int>(alignment));
+    if (!ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void HeapArenaResource::do_deallocate(void* ptr, size_t, size_t)
+{
+    m_Arena.free(ptr);
+}
+
+void* LinearAllocatorResource::do_allocate(size_t bytes, size_t alignment)
+{
+    void* ptr = m_Allocator.alloc(bytes, static_cast<unsigned int>(alignment));
+    if (!ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+// Constructor
+FixedSizePoolResource::FixedSizePoolResource(HeapManager& heapManager)
+    : m_HeapManager(heapManager), m_pPools(), m_pCurrentPools()
+{
+}
+
+// Destructor
+FixedSizePoolResource::~FixedSizePoolResource()
+{
+    Release();
+}
+
+// Size class serving a request, or s_NumSizeClasses when it goes to the heap.
+// Like the aligned operator new, an aligned request uses a class whose block
+// size is a multiple of the alignment.
+size_t FixedSizePoolResource::GetPoolSizeClass(size_t bytes, size_t alignment)
+{
+    if (alignment <= s_SizeClassGranularity)
+        return bytes <= s_MaxSmallObjectSize ? GetSizeClass(bytes) : s_NumSizeClasses;
+    if (alignment > s_MaxPoolAlignment)
+        return s_NumSizeClasses;
+
+    size_t alignedSize = (bytes + alignment - 1) & ~(alignment - 1);
+    if (alignedSize > s_MaxSmallObjectSize || GetSizeClassBlockSize(GetSizeClass(alignedSize)) % alignment != 0)
+        return s_NumSizeClasses;
+    return GetSizeClass(alignedSize);
+}
+
+// Makes a pool of the class with a free block current, carving a new one
+// from the heap when every pool is full
+FixedSizePoolResource::Pool* FixedSizePoolResource::FindOrAddPool(size_t sizeClass)
+{
+    for (Pool* pPool = m_pPools[sizeClass]; pPool; pPool = pPool->m_pNext)
+    {
+        if (!pPool->IsFull())
+        {
+            m_pCurrentPools[sizeClass] = pPool;
+            return pPool;
+        }
+    }
+
+    void* pMemory = m_HeapManager.alloc(s_PoolSize, static_cast<unsigned int>(s_PoolSize));
+    if (!pMemory)
+        return nullptr;
+
+    size_t blockSize = GetSizeClassBlockSize(sizeClass);
+    Pool* pPool = new (pMemory) Pool(blockSize, (s_PoolSize - s_PoolHeaderSize) / blockSize,
+        static_cast<char*>(pMemory) + s_PoolHeaderSize);
+    pPool->m_pNext = m_pPools[sizeClass];
+    m_pPools[sizeClass] = pPool;
+    m_pCurrentPools[sizeClass] = pPool;
+    return pPool;
+}
+
+void* FixedSizePoolResource::do_allocate(size_t bytes, size_t alignment)
+{
+    void* ptr;
+    size_t sizeClass = GetPoolSizeClass(bytes, alignment);
+    if (sizeClass == s_NumSizeClasses)
+    {
+        ptr = m_HeapManager.alloc(bytes, static_cast<unsigned int>(alignment));
+    }
+    else
+    {
+        Pool* pPool = m_pCurrentPools[sizeClass];
+        ptr = pPool ? pPool->m_Allocator.alloc() : nullptr;
+        if (!ptr && (pPool = FindOrAddPool(sizeClass)) != nullptr)
+        {
+            ptr = pPool->m_Allocator.alloc();
+        }
+    }
+
+    if (!ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+// A block freed into a pool becomes the next one handed out when the current
+// pool has filled up, so allocation only searches the pools when all are full
+void FixedSizePoolResource::do_deallocate(void* ptr, size_t bytes, size_t alignment)
+{
+    size_t sizeClass = GetPoolSizeClass(bytes, alignment);
+    if (sizeClass == s_NumSizeClasses)
+    {
+        m_HeapManager.Free(ptr);
+        return;
+    }
+
+    Pool* pPool = reinterpret_cast<Pool*>(reinterpret_cast<uintptr_t>(ptr) & ~(s_PoolSize - 1));
+    pPool->m_Allocator.free(ptr);
+    if (m_pCurrentPools[sizeClass]->IsFull())
+    {
+        m_pCurrentPools[sizeClass] = pPool;
+    }
+}
+
+void FixedSizePoolResource::Release()
+{
+    for (size_t i = 0; i < s_NumSizeClasses; ++i)
+    {
+        Pool* pPool = m_pPools[i];
+        while (pPool)
+        {
+            Pool* pNext = pPool->m_pNext;
+            pPool->~Pool();
+            m_HeapManager.Free(pPool);
+            pPool = pNext;
+        }
+        m_pPools[i] = nullptr;
+        m_pCurrentPools[i] = nullptr;
+    }
+}
+
+size_t FixedSizePoolResource::GetPoolCount() const
+{
+    size_t count = 0;
+    for (size_t i = 0; i < s_NumSizeClasses; ++i)
+    {
+        for (Pool* pPool = m_pPools[i]; pPool; pPool = pPool->m_pNext)
+        {
+            ++count;
+        }
+    }
+    return count;
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include "FixedSizeAllocator.h"
+#include "SizeClasses.h"
+#include <cstddef>
+#include <memory_resource>
+
+class HeapArena;
+class HeapManager;
+class LinearAllocator;
+
+// std::pmr::memory_resource adapters, so a single container can be put on a
+// heap of its own without the global operator new/malloc replacement:
+//
+//   HeapManagerResource resource(heap);
+//   std::pmr::unordered_map<int, Node> nodes(&resource);
+//
+// allocate throws std::bad_alloc when the allocator underneath is out of
+// memory, as memory_resource requires. A resource has to outlive the
+// containers using it, and compares equal only to itself.
+
+// HeapManager::alloc(Size, Alignment) and Free. Not thread-safe, like the heap.
+class HeapManagerResource : public std::pmr::memory_resource
+{
+private:
+    HeapManager& m_HeapManager;
+
+    void* do_allocate(size_t i_Bytes, size_t i_Alignment) override;
+    void do_deallocate(void* ptr, size_t i_Bytes, size_t i_Alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& i_Other) const noexcept override { return this == &i_Other; }
+
+public:
+    explicit HeapManagerResource(HeapManager& i_HeapManager) : m_HeapManager(i_HeapManager) {}
+
+    HeapManager& GetHeapManager() const { return m_HeapManager; }
+};
+
+// HeapArena::alloc(Size, Alignment) and free; usable from any thread
+class HeapArenaResource : public std::pmr::memory_resource
+{
+private:
+    HeapArena& m_Arena;
+
+    void* do_allocate(size_t i_Bytes, size_t i_Alignment) override;
+    void do_deallocate(void* ptr, size_t i_Bytes, size_t i_Alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& i_Other) const noexcept override { return this == &i_Other; }
+
+public:
+    explicit HeapArenaResource(HeapArena& i_Arena) : m_Arena(i_Arena) {}
+
+    HeapArena& GetArena() const { return m_Arena; }
+};
+
+// Bump allocation from a LinearAllocator. deallocate does nothing: the memory
+// comes back when the allocator is Reset or rewound past it, which must not
+// happen while a container still uses it. Not thread-safe.
+class LinearAllocatorResource : public std::pmr::memory_resource
+{
+private:
+    LinearAllocator& m_Allocator;
+
+    void* do_allocate(size_t i_Bytes, size_t i_Alignment) override;
+    void do_deallocate(void*, size_t, size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource& i_Other) const noexcept override { return this == &i_Other; }
+
+public:
+    explicit LinearAllocatorResource(LinearAllocator& i_Allocator) : m_Allocator(i_Allocator) {}
+
+    LinearAllocator& GetAllocator() const { return m_Allocator; }
+};
+
+// Requests of up to s_MaxSmallObjectSize bytes go to FreeList-mode
+// FixedSizeAllocators, a list of pools per size class. Every pool is a
+// s_PoolSize-aligned heap block holding the allocator followed by its blocks,
+// so deallocate finds a block's pool by masking its address. Larger and
+// over-aligned requests go to the heap directly. Pools stay with the resource
+// until Release, so a container's nodes stay packed together. Not thread-safe.
+class FixedSizePoolResource : public std::pmr::memory_resource
+{
+public:
+    static const size_t s_PoolSize = 64 * 1024;
+    static const size_t s_MaxPoolAlignment = 64;
+
+private:
+    struct Pool {
+        FixedSizeAllocator<> m_Allocator;
+        Pool* m_pNext;
+
+        Pool(size_t i_BlockSize, size_t i_NumBlocks, void* i_pBlocks)
+            : m_Allocator(i_BlockSize, i_NumBlocks, i_pBlocks, FixedSizeAllocatorMode::FreeList, false), m_pNext(nullptr) {}
+        bool IsFull() const { return m_Allocator.GetNumAllocated() == m_Allocator.GetNumBlocks(); }
+    };
+
+    // Blocks start this far into their pool, which keeps them aligned to any
+    // power of two up to s_MaxPoolAlignment that divides the block size
+    static const size_t s_PoolHeaderSize = (sizeof(Pool) + s_MaxPoolAlignment - 1) & ~(s_MaxPoolAlignment - 1);
+
+    HeapManager& m_HeapManager;
+    Pool* m_pPools[s_NumSizeClasses];           // every pool of the class, newest first
+    Pool* m_pCurrentPools[s_NumSizeClasses];    // the pool the class allocates from
+
+    static size_t GetPoolSizeClass(size_t i_Bytes, size_t i_Alignment);
+    Pool* FindOrAddPool(size_t i_SizeClass);
+
+    void* do_allocate(size_t i_Bytes, size_t i_Alignment) override;
+    void do_deallocate(void* ptr, size_t i_Bytes, size_t i_Alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& i_Other) const noexcept override { return this == &i_Other; }
+
+public:
+    explicit FixedSizePoolResource(HeapManager& i_HeapManager);
+    ~FixedSizePoolResource();
+
+    FixedSizePoolResource(const FixedSizePoolResource&) = delete;
+    FixedSizePoolResource& operator=(const FixedSizePoolResource&) = delete;
+
+    // Returns every pool to the heap; blocks still allocated from them become invalid
+    void Release();
+
+    size_t GetPoolCount() const;
+};
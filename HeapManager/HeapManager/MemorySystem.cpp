@@ -1,13 +1,66 @@
 #include "MemorySystem.h"
 #include "HeapManager.h"
-#include "FixedSizeAllocator.h"
+#include "HeapArena.h"
+#include "HugeAllocator.h"
+#include "PageMap.h"
+#include "SizeClasses.h"
+#include "SlabAllocator.h"
 #include <cstdio>
+#include <inttypes.h>
+#include <mutex>
+#include <new>
 
 // Global variables for memory system
-HeapManager* s_pHeapManager = nullptr;
-FixedSizeAllocator* s_pAllocators[3] = { nullptr, nullptr, nullptr };
+HeapManager* s_pHeapManager = nullptr;    // arena 0's heap, the small-object slabs are carved from it
+SlabAllocator* s_pAllocators[s_NumSizeClasses] = {};
+alignas(SlabAllocator) static unsigned char s_SlabAllocatorStorage[s_NumSizeClasses][sizeof(SlabAllocator)];
+HeapArena* s_pHeapArenas[s_MaxHeapArenas] = {};
+unsigned int s_NumHeapArenas = 0;
 
-bool InitializeMemorySystem(void* i_pHeapMemory, size_t i_sizeHeapMemory, unsigned int i_OptionalNumDescriptors)
+// Owner of every page handed to the allocators above, for free() and _msize
+PageMap s_PageMap;
+
+// Guards s_pAllocators; only the slow paths take it. Each HeapArena has its own lock.
+std::mutex s_MemorySystemMutex;
+
+// Requests at or above its threshold bypass the arenas and get their own mapping
+HugeAllocator s_HugeAllocator(s_PageMap, s_MemorySystemMutex);
+
+// Registers the arenas in the page map, publishes them and creates the
+// small-object size classes on top of arena 0
+static void PublishMemorySystem(HeapArena* pArenas[], unsigned int numArenas)
+{
+    for (unsigned int i = 0; i < numArenas; ++i)
+    {
+        HeapManager* pHeap = pArenas[i]->GetHeapManager();
+        s_PageMap.SetRange(pHeap->GetHeapMemory(), pHeap->GetReservedSize(), PageOwner{ PageOwnerKind::HeapArena, static_cast<uint8_t>(i) });
+    }
+
+    // Publish the arenas; from here on operator new allocates from them
+    for (unsigned int i = 0; i < numArenas; ++i)
+    {
+        s_pHeapArenas[i] = pArenas[i];
+    }
+    s_NumHeapArenas = numArenas;
+    s_pHeapManager = s_pHeapArenas[0]->GetHeapManager();
+
+    // Log successful creation
+    printf("HeapManager created at address: %p (%u arenas)\n", s_pHeapManager, numArenas);
+
+    // Create the small-object size classes; their slabs come from arena 0 on
+    // demand. The allocators themselves live in static storage: operator new
+    // would put them in the size classes they are building, and the arena
+    // statistics should only count what users allocated.
+    for (size_t i = 0; i < s_NumSizeClasses; ++i)
+    {
+        s_pAllocators[i] = new (s_SlabAllocatorStorage[i]) SlabAllocator(GetSizeClassBlockSize(i), PageOwner{ PageOwnerKind::SizeClass, static_cast<uint8_t>(i) },
+            s_pHeapArenas[0], PageOwner{ PageOwnerKind::HeapArena, 0 }, s_PageMap);
+    }
+
+    printf("Memory System initialization complete.\n");
+}
+
+bool InitializeMemorySystem(void* i_pHeapMemory, size_t i_sizeHeapMemory, unsigned int i_OptionalNumDescriptors, unsigned int i_NumArenas)
 {
     printf("Starting Memory System initialization...\n");
 
@@ -18,68 +71,313 @@ bool InitializeMemorySystem(void* i_pHeapMemory, size_t i_sizeHeapMemory, unsign
         return false;
     }
 
-    // Initialize HeapManager
-    s_pHeapManager = new HeapManager(i_pHeapMemory, i_sizeHeapMemory, i_OptionalNumDescriptors);
-    if (!s_pHeapManager)
+    if (i_NumArenas == 0 || i_NumArenas > s_MaxHeapArenas)
     {
-        printf("Error: HeapManager creation failed.\n");
+        printf("Error: Arena count %u must be between 1 and %u.\n", i_NumArenas, s_MaxHeapArenas);
         return false;
     }
 
-    // Log successful creation
-    printf("HeapManager created at address: %p\n", s_pHeapManager);
+    // Initialize one HeapArena per slice of the heap. Slices meet on page
+    // boundaries so each page of the map has a single arena.
+    uintptr_t heapStart = reinterpret_cast<uintptr_t>(i_pHeapMemory);
+    uintptr_t arenaBounds[s_MaxHeapArenas + 1];
+    for (unsigned int i = 1; i < i_NumArenas; ++i)
+    {
+        arenaBounds[i] = (heapStart + i_sizeHeapMemory / i_NumArenas * i) & ~(PageMap::s_PageSize - 1);
+    }
+    arenaBounds[0] = heapStart;
+    arenaBounds[i_NumArenas] = heapStart + i_sizeHeapMemory;
 
-    // Allocate memory for FixedSizeAllocators
-    void* blockMemory = s_pHeapManager->alloc(16 * 100);
-    if (!blockMemory)
+    HeapArena* pArenas[s_MaxHeapArenas];
+    for (unsigned int i = 0; i < i_NumArenas; ++i)
     {
-        printf("Error: Unable to allocate memory for 16-byte FixedSizeAllocator.\n");
-        return false;
+        void* pArenaMemory = reinterpret_cast<void*>(arenaBounds[i]);
+        pArenas[i] = new HeapArena(pArenaMemory, arenaBounds[i + 1] - arenaBounds[i], i_OptionalNumDescriptors);
     }
-    s_pAllocators[0] = new FixedSizeAllocator(16, 100, blockMemory);
 
-    blockMemory = s_pHeapManager->alloc(32 * 200);
-    if (!blockMemory)
+    PublishMemorySystem(pArenas, i_NumArenas);
+    return true;
+}
+
+bool InitializeMemorySystem(size_t i_ReserveSize, unsigned int i_NumArenas)
+{
+    printf("Starting Memory System initialization (OS-backed, %zu bytes reserved)...\n", i_ReserveSize);
+
+    if (i_NumArenas == 0 || i_NumArenas > s_MaxHeapArenas)
     {
-        printf("Error: Unable to allocate memory for 32-byte FixedSizeAllocator.\n");
+        printf("Error: Arena count %u must be between 1 and %u.\n", i_NumArenas, s_MaxHeapArenas);
         return false;
     }
-    s_pAllocators[1] = new FixedSizeAllocator(32, 200, blockMemory);
 
-    blockMemory = s_pHeapManager->alloc(96 * 400);
-    if (!blockMemory)
+    // Every arena reserves its own share of the address space and starts small
+    const size_t initialArenaSize = 256 * 1024;
+    HeapArena* pArenas[s_MaxHeapArenas];
+    for (unsigned int i = 0; i < i_NumArenas; ++i)
     {
-        printf("Error: Unable to allocate memory for 96-byte FixedSizeAllocator.\n");
-        return false;
+        pArenas[i] = new HeapArena(i_ReserveSize / i_NumArenas, initialArenaSize);
+        if (!pArenas[i]->GetHeapManager()->GetHeapMemory())
+        {
+            printf("Error: Unable to reserve memory for arena %u.\n", i);
+            for (unsigned int j = 0; j <= i; ++j)
+            {
+                delete pArenas[j];
+            }
+            return false;
+        }
     }
-    s_pAllocators[2] = new FixedSizeAllocator(96, 400, blockMemory);
 
-    printf("Memory System initialization complete.\n");
+    PublishMemorySystem(pArenas, i_NumArenas);
     return true;
 }
 
+// Hands empty slabs back first so the arenas can coalesce them, including
+// the ones only held by the calling thread's cache
+static void ReleaseAllEmptySlabs()
+{
+    FlushThreadCache();
+
+    std::lock_guard<std::mutex> lock(s_MemorySystemMutex);
+    for (SlabAllocator* pAllocator : s_pAllocators)
+    {
+        if (pAllocator)
+        {
+            pAllocator->ReleaseEmptySlabs();
+        }
+    }
+}
+
 void Collect()
 {
-    // Trigger a collection in the HeapManager
-    s_pHeapManager->Collect();
+    ReleaseAllEmptySlabs();
+    s_HugeAllocator.ReleaseCachedMappings();
+
+    // Trigger a collection in every arena, which also returns their remote frees
+    for (unsigned int i = 0; i < s_NumHeapArenas; ++i)
+    {
+        s_pHeapArenas[i]->Collect();
+    }
+}
+
+bool Collect(size_t i_BlockBudget)
+{
+    ReleaseAllEmptySlabs();
+
+    bool passesDone = true;
+    for (unsigned int i = 0; i < s_NumHeapArenas; ++i)
+    {
+        passesDone &= s_pHeapArenas[i]->Collect(i_BlockBudget);
+    }
+    return passesDone;
+}
+
+void SetDeferredCoalescing(bool i_Defer)
+{
+    for (unsigned int i = 0; i < s_NumHeapArenas; ++i)
+    {
+        s_pHeapArenas[i]->SetDeferredCoalescing(i_Defer);
+    }
+}
+
+void SetHugeAllocationThreshold(size_t i_Threshold)
+{
+    s_HugeAllocator.SetThreshold(i_Threshold);
+}
+
+size_t GetSmallObjectBytes()
+{
+    std::lock_guard<std::mutex> lock(s_MemorySystemMutex);
+    size_t bytes = 0;
+    for (SlabAllocator* pAllocator : s_pAllocators)
+    {
+        bytes += pAllocator ? pAllocator->GetSlabBytes() : 0;
+    }
+    return bytes;
+}
+
+size_t GetPeakSmallObjectBytes()
+{
+    std::lock_guard<std::mutex> lock(s_MemorySystemMutex);
+    size_t bytes = 0;
+    for (SlabAllocator* pAllocator : s_pAllocators)
+    {
+        bytes += pAllocator ? pAllocator->GetPeakSlabBytes() : 0;
+    }
+    return bytes;
+}
+
+MemoryStats GetStats()
+{
+    MemoryStats stats = {};
+
+    uint64_t allocCount[s_NumSizeClasses];
+    uint64_t freeCount[s_NumSizeClasses];
+    ThreadStats::Sum(allocCount, freeCount);
+
+    size_t slabBytes = 0;
+    {
+        std::lock_guard<std::mutex> lock(s_MemorySystemMutex);
+        for (size_t i = 0; i < s_NumSizeClasses; ++i)
+        {
+            SizeClassStats& sizeClass = stats.SizeClasses[i];
+            sizeClass.BlockSize = GetSizeClassBlockSize(i);
+            sizeClass.AllocCount = allocCount[i];
+            sizeClass.FreeCount = freeCount[i];
+
+            // A block freed on one thread may be counted before its alloc on another
+            sizeClass.BytesInUse = allocCount[i] > freeCount[i] ? (allocCount[i] - freeCount[i]) * sizeClass.BlockSize : 0;
+            if (s_pAllocators[i])
+            {
+                sizeClass.SlabBytes = s_pAllocators[i]->GetSlabBytes();
+                sizeClass.PeakSlabBytes = s_pAllocators[i]->GetPeakSlabBytes();
+            }
+
+            slabBytes += sizeClass.SlabBytes;
+            stats.BytesInUse += sizeClass.BytesInUse;
+            stats.AllocCount += sizeClass.AllocCount;
+            stats.FreeCount += sizeClass.FreeCount;
+        }
+
+        // Arenas are only unpublished under the lock
+        stats.NumArenas = s_NumHeapArenas;
+        for (unsigned int i = 0; i < s_NumHeapArenas; ++i)
+        {
+            stats.Arenas[i] = s_pHeapArenas[i]->GetStats();
+            stats.ArenaFreeSpace[i] = s_pHeapArenas[i]->GetFreeSpaceStats();
+        }
+    }
+
+    size_t arenaBytes = 0;
+    for (unsigned int i = 0; i < stats.NumArenas; ++i)
+    {
+        arenaBytes += stats.Arenas[i].BytesInUse;
+        stats.AllocCount += stats.Arenas[i].AllocCount;
+        stats.FreeCount += stats.Arenas[i].FreeCount;
+    }
+    stats.BytesInUse += arenaBytes > slabBytes ? arenaBytes - slabBytes : 0;
+
+    stats.Huge = s_HugeAllocator.GetStats();
+    stats.BytesInUse += stats.Huge.BytesInUse;
+    stats.AllocCount += stats.Huge.AllocCount;
+    stats.FreeCount += stats.Huge.FreeCount;
+    return stats;
+}
+
+static void DumpAllocatorStatsJson(const AllocatorStats& stats, FILE* pFile)
+{
+    fprintf(pFile, "{\"bytes_in_use\":%zu,\"peak_bytes_in_use\":%zu,\"alloc_count\":%" PRIu64 ",\"free_count\":%" PRIu64 "}",
+        stats.BytesInUse, stats.PeakBytesInUse, stats.AllocCount, stats.FreeCount);
+}
+
+// The histogram only lists non-empty buckets, keyed by their smallest size
+static void DumpFreeSpaceStatsJson(const FreeSpaceStats& stats, FILE* pFile)
+{
+    fprintf(pFile, "{\"free_bytes\":%zu,\"free_block_count\":%zu,\"largest_free_block\":%zu,\"external_fragmentation\":%.4f,\"histogram\":{",
+        stats.FreeBytes, stats.FreeBlockCount, stats.LargestFreeBlock, stats.GetExternalFragmentation());
+    bool first = true;
+    for (size_t i = 0; i < FreeSpaceStats::s_NumSizeBuckets; ++i)
+    {
+        if (stats.FreeBlockHistogram[i] != 0)
+        {
+            fprintf(pFile, "%s\"%zu\":%zu", first ? "" : ",", size_t(1) << i, stats.FreeBlockHistogram[i]);
+            first = false;
+        }
+    }
+    fprintf(pFile, "}}");
+}
+
+// Writes the snapshot as a single line of JSON
+void DumpStatsJson(const MemoryStats& stats, FILE* pFile)
+{
+    fprintf(pFile, "{\"bytes_in_use\":%zu,\"alloc_count\":%" PRIu64 ",\"free_count\":%" PRIu64 ",\"size_classes\":[",
+        stats.BytesInUse, stats.AllocCount, stats.FreeCount);
+    for (size_t i = 0; i < s_NumSizeClasses; ++i)
+    {
+        const SizeClassStats& sizeClass = stats.SizeClasses[i];
+        fprintf(pFile, "%s{\"block_size\":%zu,\"alloc_count\":%" PRIu64 ",\"free_count\":%" PRIu64
+            ",\"bytes_in_use\":%zu,\"slab_bytes\":%zu,\"peak_slab_bytes\":%zu}", i > 0 ? "," : "",
+            sizeClass.BlockSize, sizeClass.AllocCount, sizeClass.FreeCount, sizeClass.BytesInUse, sizeClass.SlabBytes, sizeClass.PeakSlabBytes);
+    }
+
+    fprintf(pFile, "],\"arenas\":[");
+    for (unsigned int i = 0; i < stats.NumArenas; ++i)
+    {
+        if (i > 0)
+        {
+            fputc(',', pFile);
+        }
+        DumpAllocatorStatsJson(stats.Arenas[i], pFile);
+    }
+
+    fprintf(pFile, "],\"arena_free_space\":[");
+    for (unsigned int i = 0; i < stats.NumArenas; ++i)
+    {
+        if (i > 0)
+        {
+            fputc(',', pFile);
+        }
+        DumpFreeSpaceStatsJson(stats.ArenaFreeSpace[i], pFile);
+    }
+
+    fprintf(pFile, "],\"huge\":");
+    DumpAllocatorStatsJson(stats.Huge, pFile);
+    fprintf(pFile, "}\n");
 }
 
 void DestroyMemorySystem()
 {
     printf("Starting Memory System shutdown...\n");
 
-    // Release all FixedSizeAllocators
-    for (auto& allocator : s_pAllocators)
+    // Blocks cached by other threads are returned when those threads exit,
+    // so they must be joined before shutdown
+    FlushThreadCache();
+
+    // Unpublish under the lock, then delete outside it. The slabs were
+    // created from arena 0, so they go first while the arenas are still published.
+    SlabAllocator* pAllocators[s_NumSizeClasses];
     {
-        delete allocator;
-        allocator = nullptr;
+        std::lock_guard<std::mutex> lock(s_MemorySystemMutex);
+        for (size_t i = 0; i < s_NumSizeClasses; ++i)
+        {
+            pAllocators[i] = s_pAllocators[i];
+            s_pAllocators[i] = nullptr;
+        }
     }
 
-    // Release the HeapManager
-    if (s_pHeapManager)
+    // Huge allocations still live are the caller's leaks, but the freed
+    // mappings kept for reuse are the memory system's own
+    s_HugeAllocator.ReleaseCachedMappings();
+
+    // Release all size classes and their slabs
+    for (SlabAllocator* pAllocator : pAllocators)
     {
-        delete s_pHeapManager;
+        if (pAllocator)
+        {
+            pAllocator->~SlabAllocator();
+        }
+    }
+
+    HeapArena* pArenas[s_MaxHeapArenas];
+    unsigned int numArenas;
+    {
+        std::lock_guard<std::mutex> lock(s_MemorySystemMutex);
+        numArenas = s_NumHeapArenas;
+        s_NumHeapArenas = 0;
+        for (unsigned int i = 0; i < numArenas; ++i)
+        {
+            pArenas[i] = s_pHeapArenas[i];
+            s_pHeapArenas[i] = nullptr;
+        }
         s_pHeapManager = nullptr;
+        s_PageMap.Reset();
+    }
+
+    // Release the arenas and their HeapManagers
+    if (numArenas > 0)
+    {
+        for (unsigned int i = 0; i < numArenas; ++i)
+        {
+            delete pArenas[i];
+        }
         printf("HeapManager successfully destroyed.\n");
     }
     else
@@ -1,9 +1,68 @@
 #pragma once
+#include "AllocatorStats.h"
+#include "HeapArena.h"
+#include "Platform.h"
+#include "SizeClasses.h"
+#include <cstdio>
 
-bool InitializeMemorySystem(void* i_pHeapMemory, size_t i_sizeHeapMemory, unsigned int i_OptionalNumDescriptors);
+// The heap memory is split evenly between i_NumArenas HeapArenas; threads are
+// assigned to them round-robin for allocations above the small-object sizes
+bool InitializeMemorySystem(void* i_pHeapMemory, size_t i_sizeHeapMemory, unsigned int i_OptionalNumDescriptors, unsigned int i_NumArenas = 1);
+
+// OS-backed variant: the arenas reserve i_ReserveSize bytes of address space
+// between them, commit it as they grow and purge idle free pages in Collect
+bool InitializeMemorySystem(size_t i_ReserveSize, unsigned int i_NumArenas = 1);
+
+// Full collection; also unmaps the freed huge mappings kept for reuse
 void Collect();
+// Bounded pause: each arena walks at most i_BlockBudget blocks of its heap,
+// continuing where the previous call stopped. Returns true once every arena
+// has finished a pass.
+bool Collect(size_t i_BlockBudget);
 void DestroyMemorySystem();
 
+// Arenas leave freed blocks unmerged until an allocation finds no fit or a
+// collection reaches them; off by default
+void SetDeferredCoalescing(bool i_Defer);
+
+// Returns the calling thread's cached small blocks to the shared size classes
+void FlushThreadCache();
+
+// malloc and operator new requests of at least i_Threshold bytes (256 KB by
+// default) are mapped directly from the OS instead of coming from an arena
+void SetHugeAllocationThreshold(size_t i_Threshold);
+
+// Heap bytes held by the small-object slabs right now, and the most held at once
+size_t GetSmallObjectBytes();
+size_t GetPeakSmallObjectBytes();
+
+// Point-in-time view of every allocator in the memory system. Each allocator
+// is read consistently on its own, but the snapshot as a whole isn't atomic.
+struct SizeClassStats {
+    size_t BlockSize;
+    uint64_t AllocCount;        // blocks handed out by malloc/new, summed over threads
+    uint64_t FreeCount;
+    size_t BytesInUse;          // in whole blocks
+    size_t SlabBytes;           // arena 0 memory held by the class
+    size_t PeakSlabBytes;
+};
+
+struct MemoryStats {
+    SizeClassStats SizeClasses[s_NumSizeClasses];
+    AllocatorStats Arenas[s_MaxHeapArenas];         // includes the small-object slabs carved from arena 0
+    FreeSpaceStats ArenaFreeSpace[s_MaxHeapArenas];
+    unsigned int NumArenas;
+    AllocatorStats Huge;
+    size_t BytesInUse;          // everything handed out, with slabs counted through their blocks
+    uint64_t AllocCount;
+    uint64_t FreeCount;
+};
+
+MemoryStats GetStats();
+void DumpStatsJson(const MemoryStats& i_Stats, FILE* i_pFile);
+
 void* __cdecl malloc(size_t i_size);
 void  __cdecl free(void* i_ptr);
+void* __cdecl realloc(void* i_ptr, size_t i_size);
+void* __cdecl calloc(size_t i_count, size_t i_size);
 void* operator new(size_t i_size);
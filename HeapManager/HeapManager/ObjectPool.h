@@ -0,0 +1,140 @@
+#pragma once
+#include "FixedSizeAllocator.h"
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+// Typed pool of T on a FreeList-mode FixedSizeAllocator whose block size and
+// alignment come from T at compile time. construct/destroy are O(1), and
+// destroy_all runs the destructors of the live objects in address order by
+// walking the allocation bits, then frees every block at once. The memory is
+// the caller's, NumObjects blocks of s_BlockSize aligned to s_BlockAlignment.
+// Not thread-safe.
+template<typename T>
+class ObjectPool
+{
+public:
+    // A free block holds the free list's next pointer
+    static const size_t s_BlockAlignment = alignof(T) > alignof(void*) ? alignof(T) : alignof(void*);
+    static const size_t s_BlockSize = ((sizeof(T) > sizeof(void*) ? sizeof(T) : sizeof(void*)) + s_BlockAlignment - 1) & ~(s_BlockAlignment - 1);
+
+private:
+    FixedSizeAllocator<s_BlockSize> m_Allocator;
+
+public:
+    ObjectPool(size_t i_NumObjects, void* i_pMemory)
+        : m_Allocator(i_NumObjects, i_pMemory, FixedSizeAllocatorMode::FreeList, true)
+    {
+        assert(reinterpret_cast<uintptr_t>(i_pMemory) % s_BlockAlignment == 0);
+    }
+    ~ObjectPool() { destroy_all(); }
+
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool& operator=(const ObjectPool&) = delete;
+
+    // nullptr when the pool is full
+    template<typename... Args>
+    T* construct(Args&&... i_Args)
+    {
+        void* pBlock = m_Allocator.alloc();
+        if (!pBlock)
+            return nullptr;
+
+        try
+        {
+            return new (pBlock) T(std::forward<Args>(i_Args)...);
+        }
+        catch (...)
+        {
+            m_Allocator.free(pBlock);
+            throw;
+        }
+    }
+
+    void destroy(T* ptr)
+    {
+        ptr->~T();
+        m_Allocator.free(ptr);
+    }
+
+    void destroy_all()
+    {
+        m_Allocator.ForEachAllocated([](void* pBlock) { static_cast<T*>(pBlock)->~T(); });
+        m_Allocator.FreeAll();
+    }
+
+    // Uninitialized blocks, for ObjectPoolAllocator
+    void* AllocBlock() { return m_Allocator.alloc(); }
+    void FreeBlock(void* ptr) { m_Allocator.free(ptr); }
+
+    bool Contains(void* ptr) const { return m_Allocator.Contains(ptr); }
+    size_t GetNumObjects() const { return m_Allocator.GetNumAllocated(); }
+    size_t GetCapacity() const { return m_Allocator.GetNumBlocks(); }
+    AllocatorStats GetStats() const { return m_Allocator.GetStats(); }
+};
+
+// Element type for a pool that serves a node-based container's nodes rather
+// than bare T: room for T plus the links a std::list, std::set or std::map
+// node carries, at most four pointers' worth
+template<typename T>
+struct ContainerNode {
+    alignas(T) unsigned char Value[sizeof(T)];
+    void* Links[4];
+};
+
+// STL allocator that takes single objects of any type fitting in Node from
+// an ObjectPool<Node>, and anything else (arrays, a container's bookkeeping,
+// objects once the pool is full) from operator new:
+//
+//   ObjectPool<ContainerNode<Message>> pool(1024, pMemory);
+//   std::list<Message, ObjectPoolAllocator<Message, ContainerNode<Message>>> messages(pool);
+//
+// Copies and rebinds share the pool, which must outlive the container.
+template<typename T, typename Node = T>
+class ObjectPoolAllocator
+{
+private:
+    ObjectPool<Node>* m_pPool;
+
+    static const bool s_FitsInPool = sizeof(T) <= ObjectPool<Node>::s_BlockSize && alignof(T) <= ObjectPool<Node>::s_BlockAlignment;
+
+    template<typename, typename>
+    friend class ObjectPoolAllocator;
+
+public:
+    using value_type = T;
+
+    template<typename U>
+    struct rebind {
+        using other = ObjectPoolAllocator<U, Node>;
+    };
+
+    ObjectPoolAllocator(ObjectPool<Node>& i_Pool) noexcept : m_pPool(&i_Pool) {}
+    template<typename U>
+    ObjectPoolAllocator(const ObjectPoolAllocator<U, Node>& i_Other) noexcept : m_pPool(i_Other.m_pPool) {}
+
+    T* allocate(size_t i_Count)
+    {
+        if (s_FitsInPool && i_Count == 1)
+        {
+            if (void* pBlock = m_pPool->AllocBlock())
+                return static_cast<T*>(pBlock);
+        }
+        return static_cast<T*>(::operator new(i_Count * sizeof(T), std::align_val_t(alignof(T))));
+    }
+
+    void deallocate(T* ptr, size_t i_Count) noexcept
+    {
+        if (s_FitsInPool && i_Count == 1 && m_pPool->Contains(ptr))
+        {
+            m_pPool->FreeBlock(ptr);
+            return;
+        }
+        ::operator delete(ptr, std::align_val_t(alignof(T)));
+    }
+
+    template<typename U>
+    bool operator==(const ObjectPoolAllocator<U, Node>& i_Other) const noexcept { return m_pPool == i_Other.m_pPool; }
+};
@@ -0,0 +1,97 @@
+#include "PageMap.h"
+#include "Platform.h"
+#include <new>
+
+// Nodes come from _aligned_malloc directly: the map is consulted by our own
+// malloc/free, so it can't allocate through them
+
+PageMap::PageMap()
+{
+    for (auto& interior : m_Root)
+    {
+        interior.store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+PageMap::~PageMap()
+{
+    Reset();
+}
+
+PageMap::LeafNode* PageMap::GetOrCreateLeaf(uintptr_t page)
+{
+    std::atomic<InteriorNode*>& rootSlot = m_Root[page >> (2 * s_LevelBits)];
+    InteriorNode* pInterior = rootSlot.load(std::memory_order_relaxed);
+    if (!pInterior)
+    {
+        void* pMemory = _aligned_malloc(sizeof(InteriorNode), alignof(InteriorNode));
+        if (!pMemory)
+            return nullptr;
+        pInterior = new (pMemory) InteriorNode;
+        for (auto& leaf : pInterior->m_Leaves)
+        {
+            leaf.store(nullptr, std::memory_order_relaxed);
+        }
+        rootSlot.store(pInterior, std::memory_order_release);
+    }
+
+    std::atomic<LeafNode*>& interiorSlot = pInterior->m_Leaves[(page >> s_LevelBits) & (s_LevelSize - 1)];
+    LeafNode* pLeaf = interiorSlot.load(std::memory_order_relaxed);
+    if (!pLeaf)
+    {
+        void* pMemory = _aligned_malloc(sizeof(LeafNode), alignof(LeafNode));
+        if (!pMemory)
+            return nullptr;
+        pLeaf = new (pMemory) LeafNode;
+        for (auto& owner : pLeaf->m_Owners)
+        {
+            owner.store(0, std::memory_order_relaxed);
+        }
+        interiorSlot.store(pLeaf, std::memory_order_release);
+    }
+    return pLeaf;
+}
+
+bool PageMap::SetRange(void* pStart, size_t size, PageOwner owner)
+{
+    if (size == 0)
+        return true;
+
+    uintptr_t firstPage = reinterpret_cast<uintptr_t>(pStart) >> s_PageShift;
+    uintptr_t lastPage = (reinterpret_cast<uintptr_t>(pStart) + size - 1) >> s_PageShift;
+    if ((lastPage >> (3 * s_LevelBits)) != 0)
+        return false;
+
+    uint16_t packed = Pack(owner);
+    for (uintptr_t page = firstPage; page <= lastPage; ++page)
+    {
+        LeafNode* pLeaf = GetOrCreateLeaf(page);
+        if (!pLeaf)
+            return false;
+        pLeaf->m_Owners[page & (s_LevelSize - 1)].store(packed, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+// Releases every node; no Lookup may run concurrently
+void PageMap::Reset()
+{
+    for (auto& rootSlot : m_Root)
+    {
+        InteriorNode* pInterior = rootSlot.exchange(nullptr, std::memory_order_relaxed);
+        if (!pInterior)
+            continue;
+
+        for (auto& interiorSlot : pInterior->m_Leaves)
+        {
+            LeafNode* pLeaf = interiorSlot.load(std::memory_order_relaxed);
+            if (pLeaf)
+            {
+                pLeaf->~LeafNode();
+                _aligned_free(pLeaf);
+            }
+        }
+        pInterior->~InteriorNode();
+        _aligned_free(pInterior);
+    }
+}
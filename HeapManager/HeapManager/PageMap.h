@@ -0,0 +1,79 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Which allocator a page of the memory system belongs to
+enum class PageOwnerKind : uint8_t {
+    None,                   // not ours, e.g. _aligned_malloc fallback memory
+    SizeClass,              // small-object slab, Index is the size class
+    HeapArena,              // Index is the arena
+    HugeAllocation          // first page of a HugeAllocator mapping
+};
+
+struct PageOwner {
+    PageOwnerKind Kind;
+    uint8_t Index;
+};
+
+// Radix tree keyed by page number that records the owner of every page
+// handed to the memory system, so a free resolves its allocator with one
+// lookup. Three levels of 4096 entries cover 48-bit addresses; interior nodes
+// are created on demand. Lookup is lock-free, SetRange/Reset calls must be
+// serialized by the caller.
+class PageMap
+{
+public:
+    static const size_t s_PageShift = 12;
+    static const size_t s_PageSize = size_t(1) << s_PageShift;
+
+private:
+    static const size_t s_LevelBits = 12;
+    static const size_t s_LevelSize = size_t(1) << s_LevelBits;
+    static const size_t s_AddressBits = s_PageShift + 3 * s_LevelBits;
+
+    struct LeafNode {
+        std::atomic<uint16_t> m_Owners[s_LevelSize];
+    };
+    struct InteriorNode {
+        std::atomic<LeafNode*> m_Leaves[s_LevelSize];
+    };
+
+    std::atomic<InteriorNode*> m_Root[s_LevelSize];
+
+    static uint16_t Pack(PageOwner i_Owner) { return static_cast<uint16_t>((static_cast<uint16_t>(i_Owner.Kind) << 8) | i_Owner.Index); }
+    static PageOwner Unpack(uint16_t i_Packed) { return PageOwner{ static_cast<PageOwnerKind>(i_Packed >> 8), static_cast<uint8_t>(i_Packed) }; }
+
+    LeafNode* GetOrCreateLeaf(uintptr_t i_Page);
+
+public:
+    PageMap();
+    ~PageMap();
+
+    PageMap(const PageMap&) = delete;
+    PageMap& operator=(const PageMap&) = delete;
+
+    // Records i_Owner for every page overlapping [i_pStart, i_pStart + i_Size)
+    bool SetRange(void* i_pStart, size_t i_Size, PageOwner i_Owner);
+    void ClearRange(void* i_pStart, size_t i_Size) { SetRange(i_pStart, i_Size, PageOwner{ PageOwnerKind::None, 0 }); }
+    void Reset();
+
+    PageOwner Lookup(void* ptr) const
+    {
+        uintptr_t page = reinterpret_cast<uintptr_t>(ptr) >> s_PageShift;
+        if ((page >> (3 * s_LevelBits)) != 0)
+            return PageOwner{ PageOwnerKind::None, 0 };
+
+        InteriorNode* pInterior = m_Root[page >> (2 * s_LevelBits)].load(std::memory_order_acquire);
+        if (!pInterior)
+            return PageOwner{ PageOwnerKind::None, 0 };
+
+        LeafNode* pLeaf = pInterior->m_Leaves[(page >> s_LevelBits) & (s_LevelSize - 1)].load(std::memory_order_acquire);
+        if (!pLeaf)
+            return PageOwner{ PageOwnerKind::None, 0 };
+
+        return Unpack(pLeaf->m_Owners[page & (s_LevelSize - 1)].load(std::memory_order_relaxed));
+    }
+
+    static size_t RoundToPages(size_t i_Size) { return (i_Size + s_PageSize - 1) & ~(s_PageSize - 1); }
+};
@@ -0,0 +1,38 @@
+#include "Platform.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+
+void* SystemHeapAlloc(size_t size)
+{
+    return HeapAlloc(GetProcessHeap(), 0, size);
+}
+
+void* SystemHeapRealloc(void* ptr, size_t size)
+{
+    return HeapReAlloc(GetProcessHeap(), 0, ptr, size);
+}
+
+void SystemHeapFree(void* ptr)
+{
+    HeapFree(GetProcessHeap(), 0, ptr);
+}
+
+#else
+
+void* SystemHeapAlloc(size_t size)
+{
+    return __libc_malloc(size);
+}
+
+void* SystemHeapRealloc(void* ptr, size_t size)
+{
+    return __libc_realloc(ptr, size);
+}
+
+void SystemHeapFree(void* ptr)
+{
+    __libc_free(ptr);
+}
+
+#endif
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <cstdlib>
+#include <malloc.h>
+
+// What the memory system needs from the C runtime besides the functions it
+// replaces. MSVC has all of it; elsewhere the _aligned_* functions are mapped
+// onto glibc's own allocator, which stays reachable through its __libc_*
+// entry points when malloc and free are replaced.
+#ifndef _WIN32
+#define __cdecl
+
+extern "C" {
+    void* __libc_malloc(size_t i_Size);
+    void* __libc_memalign(size_t i_Alignment, size_t i_Size);
+    void* __libc_realloc(void* ptr, size_t i_Size);
+    void __libc_free(void* ptr);
+}
+
+inline void* _aligned_malloc(size_t i_Size, size_t i_Alignment)
+{
+    return __libc_memalign(i_Alignment < sizeof(void*) ? sizeof(void*) : i_Alignment, i_Size);
+}
+
+// glibc's realloc keeps its default 16-byte alignment, which is all callers ask for
+inline void* _aligned_realloc(void* ptr, size_t i_Size, size_t)
+{
+    return __libc_realloc(ptr, i_Size);
+}
+
+inline void _aligned_free(void* ptr)
+{
+    __libc_free(ptr);
+}
+#endif
+
+// Keeps one of the replaced C runtime functions out of the dynamic symbol
+// table, since they are only meant for this program's own code. The build's
+// default hidden visibility misses the ones the compiler treats as builtins,
+// and a visibility attribute is rejected because the C library's headers have
+// already declared them, so it is set in the assembler instead. The DLL
+// runtime keeps them apart on Windows.
+#ifdef _WIN32
+#define MEMORY_SYSTEM_HIDDEN(i_Function)
+#else
+#define MEMORY_SYSTEM_HIDDEN(i_Function) __asm__(".hidden " #i_Function)
+#endif
+
+// The process's own heap, unaffected by the replaced malloc: HeapAlloc on
+// Windows, glibc's allocator elsewhere. Used to compare against and for
+// memory handed to the memory system itself.
+void* SystemHeapAlloc(size_t i_Size);
+void* SystemHeapRealloc(void* ptr, size_t i_Size);
+void SystemHeapFree(void* ptr);
@@ -0,0 +1,74 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Small-object size classes, built at compile time. There is one class per 8
+// bytes below 128 and, like HeapManager's bins, 8 classes per power of two
+// above, so rounding a request up to its class wastes at most 12.5% there.
+static const size_t s_SizeClassGranularity = 8;
+static const size_t s_SizeClassLinearLimit = 128;
+static const size_t s_SizeClassSubClasses = 8;
+static const size_t s_MaxSmallObjectSize = 1024;
+
+constexpr size_t CountSizeClasses()
+{
+    size_t count = s_SizeClassLinearLimit / s_SizeClassGranularity;
+    for (size_t power = s_SizeClassLinearLimit; power < s_MaxSmallObjectSize; power *= 2)
+    {
+        count += s_SizeClassSubClasses;
+    }
+    return count;
+}
+
+static const size_t s_NumSizeClasses = CountSizeClasses();
+
+struct SizeClassTable {
+    size_t BlockSizes[s_NumSizeClasses];
+    uint8_t ClassOfSize[s_MaxSmallObjectSize / s_SizeClassGranularity + 1];     // indexed by the size in 8-byte units, rounded up
+};
+
+constexpr SizeClassTable BuildSizeClassTable()
+{
+    SizeClassTable table = {};
+
+    size_t sizeClass = 0;
+    for (size_t size = s_SizeClassGranularity; size <= s_SizeClassLinearLimit; size += s_SizeClassGranularity)
+    {
+        table.BlockSizes[sizeClass++] = size;
+    }
+    for (size_t power = s_SizeClassLinearLimit; power < s_MaxSmallObjectSize; power *= 2)
+    {
+        for (size_t step = 1; step <= s_SizeClassSubClasses; ++step)
+        {
+            table.BlockSizes[sizeClass++] = power + power / s_SizeClassSubClasses * step;
+        }
+    }
+
+    // Every size maps to the smallest class that holds it
+    sizeClass = 0;
+    for (size_t units = 0; units <= s_MaxSmallObjectSize / s_SizeClassGranularity; ++units)
+    {
+        while (table.BlockSizes[sizeClass] < units * s_SizeClassGranularity)
+        {
+            ++sizeClass;
+        }
+        table.ClassOfSize[units] = static_cast<uint8_t>(sizeClass);
+    }
+    return table;
+}
+
+inline constexpr SizeClassTable s_SizeClassTable = BuildSizeClassTable();
+
+static_assert(s_NumSizeClasses <= 256, "size classes are stored in 8 bits");
+static_assert(s_SizeClassTable.BlockSizes[s_NumSizeClasses - 1] == s_MaxSmallObjectSize, "the last class must be the small-object limit");
+
+// Size class for a request of at most s_MaxSmallObjectSize bytes: a table load, no branches
+inline size_t GetSizeClass(size_t i_Size)
+{
+    return s_SizeClassTable.ClassOfSize[(i_Size + s_SizeClassGranularity - 1) / s_SizeClassGranularity];
+}
+
+inline size_t GetSizeClassBlockSize(size_t i_SizeClass)
+{
+    return s_SizeClassTable.BlockSizes[i_SizeClass];
+}
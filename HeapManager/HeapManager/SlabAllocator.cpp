@@ -0,0 +1,236 @@
+#include "SlabAllocator.h"
+#include "HeapArena.h"
+#include <cassert>
+#include <new>
+
+// A slab's heap block is one block header short of s_SlabSize, so the header
+// of the block after it takes the slab's last bytes and the next slab can
+// start at the very next boundary, without a free gap in front of it
+static const size_t s_SlabBlockSize = SlabAllocator::s_SlabSize - sizeof(MemoryBlock);
+
+SlabAllocator::Slab::Slab(size_t blockSize, size_t numBlocks, void* pBlocks)
+    : m_Allocator(blockSize, numBlocks, pBlocks, FixedSizeAllocatorMode::FreeList), m_pNext(nullptr), m_pPrev(nullptr)
+{
+}
+
+SlabAllocator::SlabAllocator(size_t blockSize, PageOwner owner, HeapArena* pArena, PageOwner arenaOwner, PageMap& pageMap)
+    : m_BlockSize(blockSize), m_FirstBlockOffset((sizeof(Slab) + blockSize - 1) / blockSize * blockSize),
+    m_pArena(pArena), m_PageMap(pageMap), m_Owner(owner), m_ArenaOwner(arenaOwner),
+    m_pPartialSlabs(nullptr), m_pFullSlabs(nullptr), m_NumSlabs(0), m_NumEmptySlabs(0), m_PeakSlabs(0),
+    m_RetryDelay(1), m_MissesUntilRetry(0)
+{
+    assert(m_FirstBlockOffset + m_BlockSize <= s_SlabBlockSize);
+}
+
+SlabAllocator::~SlabAllocator()
+{
+    while (m_pFullSlabs)
+    {
+        ReleaseSlab(m_pFullSlabs);
+    }
+    while (m_pPartialSlabs)
+    {
+        ReleaseSlab(m_pPartialSlabs);
+    }
+}
+
+void SlabAllocator::LinkSlab(Slab*& pList, Slab* pSlab)
+{
+    pSlab->m_pPrev = nullptr;
+    pSlab->m_pNext = pList;
+    if (pList)
+    {
+        pList->m_pPrev = pSlab;
+    }
+    pList = pSlab;
+}
+
+void SlabAllocator::UnlinkSlab(Slab*& pList, Slab* pSlab)
+{
+    if (pSlab->m_pPrev)
+    {
+        pSlab->m_pPrev->m_pNext = pSlab->m_pNext;
+    }
+    else
+    {
+        pList = pSlab->m_pNext;
+    }
+    if (pSlab->m_pNext)
+    {
+        pSlab->m_pNext->m_pPrev = pSlab->m_pPrev;
+    }
+}
+
+// Pulls a new, empty slab from the arena and records its pages as ours.
+// Running out is expected, so failures are quiet and back off.
+SlabAllocator::Slab* SlabAllocator::CreateSlab()
+{
+    if (m_MissesUntilRetry > 0)
+    {
+        --m_MissesUntilRetry;
+        return nullptr;
+    }
+
+    void* pMemory = m_pArena->TryAlloc(s_SlabBlockSize, static_cast<unsigned int>(s_SlabSize));
+    if (!pMemory)
+    {
+        m_MissesUntilRetry = m_RetryDelay;
+        m_RetryDelay = m_RetryDelay < s_MaxRetryDelay ? m_RetryDelay * 2 : s_MaxRetryDelay;
+        return nullptr;
+    }
+    m_RetryDelay = 1;
+
+    size_t numBlocks = (s_SlabBlockSize - m_FirstBlockOffset) / m_BlockSize;
+    Slab* pSlab = new (pMemory) Slab(m_BlockSize, numBlocks, static_cast<char*>(pMemory) + m_FirstBlockOffset);
+    m_PageMap.SetRange(pMemory, s_SlabSize, m_Owner);
+
+    LinkSlab(m_pPartialSlabs, pSlab);
+    ++m_NumEmptySlabs;
+    if (++m_NumSlabs > m_PeakSlabs)
+    {
+        m_PeakSlabs = m_NumSlabs;
+    }
+    return pSlab;
+}
+
+// Returns a slab to the arena. Its pages are handed back to the arena in the
+// page map first, so no lookup can name a slab that no longer exists.
+void SlabAllocator::ReleaseSlab(Slab* pSlab)
+{
+    if (pSlab->IsFull())
+    {
+        UnlinkSlab(m_pFullSlabs, pSlab);
+    }
+    else
+    {
+        UnlinkSlab(m_pPartialSlabs, pSlab);
+    }
+    if (pSlab->IsEmpty())
+    {
+        --m_NumEmptySlabs;
+    }
+    --m_NumSlabs;
+
+    m_PageMap.SetRange(pSlab, s_SlabSize, m_ArenaOwner);
+    pSlab->~Slab();
+    m_pArena->free(pSlab);
+}
+
+void* SlabAllocator::alloc()
+{
+    Slab* pSlab = m_pPartialSlabs;
+    if (!pSlab)
+    {
+        pSlab = CreateSlab();
+        if (!pSlab)
+            return nullptr;
+    }
+
+    if (pSlab->IsEmpty())
+    {
+        --m_NumEmptySlabs;
+    }
+
+    void* ptr = pSlab->m_Allocator.alloc();
+    if (pSlab->IsFull())
+    {
+        UnlinkSlab(m_pPartialSlabs, pSlab);
+        LinkSlab(m_pFullSlabs, pSlab);
+    }
+    return ptr;
+}
+
+void SlabAllocator::free(void* ptr)
+{
+    Slab* pSlab = GetSlab(ptr);
+    if (pSlab->IsFull())
+    {
+        UnlinkSlab(m_pFullSlabs, pSlab);
+        LinkSlab(m_pPartialSlabs, pSlab);
+    }
+
+    pSlab->m_Allocator.free(ptr);
+
+    // Hysteresis: keep a few empty slabs for the next burst, release the rest
+    if (pSlab->IsEmpty() && ++m_NumEmptySlabs > s_EmptySlabsToKeep)
+    {
+        ReleaseSlab(pSlab);
+    }
+}
+
+// Fills the batch from the partial slabs, a slab's worth of blocks per call
+size_t SlabAllocator::AllocBatch(size_t count, void** pBlocks)
+{
+    size_t allocated = 0;
+    while (allocated < count)
+    {
+        Slab* pSlab = m_pPartialSlabs;
+        if (!pSlab)
+        {
+            pSlab = CreateSlab();
+            if (!pSlab)
+                break;
+        }
+
+        if (pSlab->IsEmpty())
+        {
+            --m_NumEmptySlabs;
+        }
+
+        allocated += pSlab->m_Allocator.AllocBatch(count - allocated, pBlocks + allocated);
+        if (pSlab->IsFull())
+        {
+            UnlinkSlab(m_pPartialSlabs, pSlab);
+            LinkSlab(m_pFullSlabs, pSlab);
+        }
+    }
+    return allocated;
+}
+
+// Frees each run of blocks from the same slab with one FreeBatch
+void SlabAllocator::FreeBatch(void** pBlocks, size_t count)
+{
+    size_t runStart = 0;
+    while (runStart < count)
+    {
+        Slab* pSlab = GetSlab(pBlocks[runStart]);
+        size_t runEnd = runStart + 1;
+        while (runEnd < count && GetSlab(pBlocks[runEnd]) == pSlab)
+        {
+            ++runEnd;
+        }
+
+        if (pSlab->IsFull())
+        {
+            UnlinkSlab(m_pFullSlabs, pSlab);
+            LinkSlab(m_pPartialSlabs, pSlab);
+        }
+
+        pSlab->m_Allocator.FreeBatch(pBlocks + runStart, runEnd - runStart);
+
+        if (pSlab->IsEmpty() && ++m_NumEmptySlabs > s_EmptySlabsToKeep)
+        {
+            ReleaseSlab(pSlab);
+        }
+        runStart = runEnd;
+    }
+}
+
+// Returns every empty slab to the arena, including the ones kept for reuse.
+// This runs as part of a collection, which may make room for a slab, so the
+// next miss tries again.
+void SlabAllocator::ReleaseEmptySlabs()
+{
+    m_MissesUntilRetry = 0;
+
+    Slab* pSlab = m_pPartialSlabs;
+    while (pSlab)
+    {
+        Slab* pNext = pSlab->m_pNext;
+        if (pSlab->IsEmpty())
+        {
+            ReleaseSlab(pSlab);
+        }
+        pSlab = pNext;
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include "FixedSizeAllocator.h"
+#include "PageMap.h"
+
+class HeapArena;
+
+// One small-object size class as a chain of slabs pulled from a HeapArena on
+// demand. Each slab is s_SlabSize bytes aligned to its size and starts with a
+// header holding its FixedSizeAllocator, so free finds the slab by masking the
+// pointer. Fully-empty slabs beyond s_EmptySlabsToKeep go back to the heap, so
+// a burst doesn't pin memory and a workload hovering at a slab boundary
+// doesn't thrash. When the arena has no room for a slab, alloc returns nullptr
+// and skips the next misses before asking again, twice as many after each
+// failure in a row, so a full heap isn't searched on every small allocation.
+// Not thread-safe: callers serialize alloc/free.
+class SlabAllocator
+{
+public:
+    static const size_t s_SlabSize = 16 * 1024;
+    static const size_t s_EmptySlabsToKeep = 1;
+    static const size_t s_MaxRetryDelay = 1024;
+
+private:
+    struct Slab {
+        FixedSizeAllocator<> m_Allocator;
+        Slab* m_pNext;
+        Slab* m_pPrev;
+
+        Slab(size_t i_BlockSize, size_t i_NumBlocks, void* i_pBlocks);
+
+        bool IsEmpty() const { return m_Allocator.GetNumAllocated() == 0; }
+        bool IsFull() const { return m_Allocator.GetNumAllocated() == m_Allocator.GetNumBlocks(); }
+    };
+
+    size_t m_BlockSize;
+    size_t m_FirstBlockOffset;  // the header is rounded up to a whole block
+    HeapArena* m_pArena;
+    PageMap& m_PageMap;
+    PageOwner m_Owner;          // recorded for slab pages
+    PageOwner m_ArenaOwner;     // restored when a slab goes back to the heap
+
+    Slab* m_pPartialSlabs;      // slabs with a free block; alloc uses the head
+    Slab* m_pFullSlabs;
+    size_t m_NumSlabs;
+    size_t m_NumEmptySlabs;
+    size_t m_PeakSlabs;
+    size_t m_RetryDelay;        // misses skipped after the next failed slab creation
+    size_t m_MissesUntilRetry;
+
+    static Slab* GetSlab(void* ptr) { return reinterpret_cast<Slab*>(reinterpret_cast<uintptr_t>(ptr) & ~(s_SlabSize - 1)); }
+    static void LinkSlab(Slab*& io_pList, Slab* i_pSlab);
+    static void UnlinkSlab(Slab*& io_pList, Slab* i_pSlab);
+
+    Slab* CreateSlab();
+    void ReleaseSlab(Slab* i_pSlab);
+
+public:
+    SlabAllocator(size_t i_BlockSize, PageOwner i_Owner, HeapArena* i_pArena, PageOwner i_ArenaOwner, PageMap& i_PageMap);
+    ~SlabAllocator();
+
+    SlabAllocator(const SlabAllocator&) = delete;
+    SlabAllocator& operator=(const SlabAllocator&) = delete;
+
+    void* alloc();
+    void free(void* ptr);
+    size_t AllocBatch(size_t i_Count, void** o_pBlocks);
+    void FreeBatch(void** i_pBlocks, size_t i_Count);
+    void ReleaseEmptySlabs();
+
+    size_t GetBlockSize() const { return m_BlockSize; }
+    size_t GetSlabBytes() const { return m_NumSlabs * s_SlabSize; }
+    size_t GetPeakSlabBytes() const { return m_PeakSlabs * s_SlabSize; }
+};
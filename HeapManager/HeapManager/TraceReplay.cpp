@@ -0,0 +1,359 @@
+#include "TraceReplay.h"
+#include "AllocationTrace.h"
+#include "HeapArena.h"
+#include "HeapManager.h"
+#include "PageMap.h"
+#include "Platform.h"
+#include "SizeClasses.h"
+#include "SlabAllocator.h"
+#include "VirtualMemory.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// Address space each replayed heap may grow into
+static const size_t s_ReplayReserveSize = size_t(1) << 30;
+// Footprints are sampled every s_FootprintInterval calls
+static const size_t s_FootprintInterval = 4096;
+
+// One traced call, with the objects renumbered into dense slots so replaying
+// is an array index instead of a map lookup
+struct ReplayOp {
+    TraceEventKind Kind;
+    uint32_t Alignment;
+    size_t Slot;
+    size_t OldSlot;     // Realloc only
+    size_t Size;
+};
+
+struct ReplayTrace {
+    std::vector<ReplayOp> Ops;
+    size_t NumSlots = 0;
+    size_t NumThreads = 0;
+    uint64_t DurationNs = 0;
+    size_t PeakLiveBytes = 0;
+    size_t NumUnmatched = 0;    // frees of unknown objects and allocs over live ones, see LoadReplayTrace
+    size_t ClassRequests[s_NumSizeClasses] = {};
+    uint64_t ClassRequestedBytes[s_NumSizeClasses] = {};
+};
+
+struct ReplayResult {
+    double ElapsedNs;
+    size_t PeakFootprint;
+    size_t Failures;
+};
+
+static FILE* OpenTraceFile(const char* pPath)
+{
+    FILE* pFile = nullptr;
+#ifdef _WIN32
+    if (fopen_s(&pFile, pPath, "rb") != 0)
+        return nullptr;
+#else
+    pFile = fopen(pPath, "rb");
+#endif
+    return pFile;
+}
+
+static bool ReadTraceEvents(const char* pPath, std::vector<TraceEvent>& events)
+{
+    FILE* pFile = OpenTraceFile(pPath);
+    if (!pFile)
+    {
+        printf("Error: could not open trace file %s.\n", pPath);
+        return false;
+    }
+
+    TraceFileHeader header;
+    if (fread(&header, sizeof(header), 1, pFile) != 1 || header.Magic != s_TraceFileMagic ||
+        header.Version != s_TraceFileVersion || header.EventSize != sizeof(TraceEvent))
+    {
+        printf("Error: %s is not an allocation trace of this version.\n", pPath);
+        fclose(pFile);
+        return false;
+    }
+
+    TraceEvent chunk[1024];
+    size_t count;
+    while ((count = fread(chunk, sizeof(TraceEvent), 1024, pFile)) > 0)
+    {
+        events.insert(events.end(), chunk, chunk + count);
+    }
+    fclose(pFile);
+    return true;
+}
+
+// Orders the events by time and turns object addresses into slots. An address
+// only names one object at a time, but threads record their events a moment
+// before a free or after an alloc returns, so a reused address can come up
+// out of order. Such events are counted as unmatched: a free of an unknown
+// object is skipped, and an alloc over a live object frees the old one first.
+static bool LoadReplayTrace(const char* pPath, ReplayTrace& trace)
+{
+    std::vector<TraceEvent> events;
+    if (!ReadTraceEvents(pPath, events))
+        return false;
+
+    std::stable_sort(events.begin(), events.end(),
+        [](const TraceEvent& a, const TraceEvent& b) { return a.Timestamp < b.Timestamp; });
+
+    std::unordered_map<uint64_t, size_t> liveSlots;
+    std::vector<size_t> slotSizes;
+    size_t liveBytes = 0;
+    trace.Ops.reserve(events.size());
+
+    auto freeSlot = [&](std::unordered_map<uint64_t, size_t>::iterator it)
+    {
+        trace.Ops.push_back(ReplayOp{ TraceEventKind::Free, 0, it->second, 0, 0 });
+        liveBytes -= slotSizes[it->second];
+        liveSlots.erase(it);
+    };
+    auto newSlot = [&](uint64_t id, size_t size)
+    {
+        auto it = liveSlots.find(id);
+        if (it != liveSlots.end())
+        {
+            ++trace.NumUnmatched;
+            freeSlot(it);
+        }
+        slotSizes.push_back(size);
+        liveSlots[id] = trace.NumSlots;
+        liveBytes += size;
+        trace.PeakLiveBytes = std::max(trace.PeakLiveBytes, liveBytes);
+        return trace.NumSlots++;
+    };
+
+    for (const TraceEvent& event : events)
+    {
+        trace.NumThreads = std::max<size_t>(trace.NumThreads, event.ThreadId + 1);
+        trace.DurationNs = event.Timestamp;
+
+        if (event.Kind == TraceEventKind::Free)
+        {
+            auto it = liveSlots.find(event.ObjectId);
+            if (it == liveSlots.end())
+            {
+                ++trace.NumUnmatched;
+                continue;
+            }
+            freeSlot(it);
+            continue;
+        }
+
+        if (event.Size <= s_MaxSmallObjectSize)
+        {
+            size_t sizeClass = GetSizeClass(event.Size);
+            ++trace.ClassRequests[sizeClass];
+            trace.ClassRequestedBytes[sizeClass] += event.Size;
+        }
+
+        auto oldIt = event.Kind == TraceEventKind::Realloc ? liveSlots.find(event.OldObjectId) : liveSlots.end();
+        if (oldIt == liveSlots.end())
+        {
+            // An alloc, or a realloc of an object the trace never saw allocated
+            if (event.Kind == TraceEventKind::Realloc)
+            {
+                ++trace.NumUnmatched;
+            }
+            size_t slot = newSlot(event.ObjectId, event.Size);
+            trace.Ops.push_back(ReplayOp{ TraceEventKind::Alloc, event.Alignment, slot, 0, event.Size });
+            continue;
+        }
+
+        size_t oldSlot = oldIt->second;
+        liveBytes -= slotSizes[oldSlot];
+        liveSlots.erase(oldIt);
+        size_t slot = newSlot(event.ObjectId, event.Size);
+        trace.Ops.push_back(ReplayOp{ TraceEventKind::Realloc, 0, slot, oldSlot, event.Size });
+    }
+    return true;
+}
+
+// Runs the trace through one allocator. Alloc(size, alignment), Free(ptr)
+// and Realloc(ptr, oldSize, size) wrap its calls; Footprint returns the memory
+// it holds from the OS. Objects still live at the end are freed untimed.
+template<typename AllocFunc, typename FreeFunc, typename ReallocFunc, typename FootprintFunc>
+static ReplayResult ReplayOps(const ReplayTrace& trace, AllocFunc Alloc, FreeFunc Free, ReallocFunc Realloc, FootprintFunc Footprint)
+{
+    std::vector<void*> objects(trace.NumSlots, nullptr);
+    std::vector<size_t> sizes(trace.NumSlots, 0);
+    ReplayResult result = { 0.0, Footprint(), 0 };
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < trace.Ops.size(); ++i)
+    {
+        const ReplayOp& op = trace.Ops[i];
+        switch (op.Kind)
+        {
+        case TraceEventKind::Alloc:
+            objects[op.Slot] = Alloc(op.Size, op.Alignment);
+            sizes[op.Slot] = op.Size;
+            if (!objects[op.Slot])
+            {
+                ++result.Failures;
+            }
+            break;
+        case TraceEventKind::Free:
+            if (objects[op.Slot])
+            {
+                Free(objects[op.Slot]);
+                objects[op.Slot] = nullptr;
+            }
+            break;
+        case TraceEventKind::Realloc:
+            if (objects[op.OldSlot])
+            {
+                // On failure the object stays where it was, at its old size
+                void* ptr = Realloc(objects[op.OldSlot], sizes[op.OldSlot], op.Size);
+                objects[op.Slot] = ptr ? ptr : objects[op.OldSlot];
+                sizes[op.Slot] = ptr ? op.Size : sizes[op.OldSlot];
+                objects[op.OldSlot] = nullptr;
+                if (!ptr)
+                {
+                    ++result.Failures;
+                }
+            }
+            break;
+        }
+
+        if (i % s_FootprintInterval == 0)
+        {
+            result.PeakFootprint = std::max(result.PeakFootprint, Footprint());
+        }
+    }
+    result.ElapsedNs = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    result.PeakFootprint = std::max(result.PeakFootprint, Footprint());
+
+    for (size_t slot = 0; slot < trace.NumSlots; ++slot)
+    {
+        if (objects[slot])
+        {
+            Free(objects[slot]);
+        }
+    }
+    return result;
+}
+
+static void PrintReplayResult(const char* pLabel, const ReplayTrace& trace, const ReplayResult& result)
+{
+    // Fragmentation is the share of the peak footprint that never held live data at the peak
+    double fragmentation = result.PeakFootprint > trace.PeakLiveBytes ?
+        100.0 * (result.PeakFootprint - trace.PeakLiveBytes) / result.PeakFootprint : 0.0;
+    printf("%24s %12.2f %14zu %13.1f%% %10zu\n", pLabel, trace.Ops.size() * 1000.0 / result.ElapsedNs,
+        result.PeakFootprint / 1024, fragmentation, result.Failures);
+}
+
+static ReplayResult ReplayHeapManager(const ReplayTrace& trace)
+{
+    HeapManager heap(s_ReplayReserveSize, 256 * 1024);
+    return ReplayOps(trace,
+        [&](size_t size, uint32_t alignment) { return alignment > 8 ? heap.alloc(std::max<size_t>(size, 1), alignment) : heap.alloc(std::max<size_t>(size, 1)); },
+        [&](void* ptr) { heap.Free(ptr); },
+        [&](void* ptr, size_t, size_t size) { return heap.Realloc(ptr, size); },
+        [&]() { return heap.GetCommittedSize(); });
+}
+
+// The memory system's small-object path without its thread caches: a
+// SlabAllocator per size class carving 16 KB slabs out of an OS-backed arena,
+// which also serves everything bigger
+static ReplayResult ReplaySizeClasses(const ReplayTrace& trace)
+{
+    HeapArena arena(s_ReplayReserveSize, 256 * 1024);
+    PageMap pageMap;
+    SlabAllocator* pClasses[s_NumSizeClasses];
+    for (size_t i = 0; i < s_NumSizeClasses; ++i)
+    {
+        pClasses[i] = new SlabAllocator(GetSizeClassBlockSize(i), PageOwner{ PageOwnerKind::SizeClass, static_cast<uint8_t>(i) },
+            &arena, PageOwner{ PageOwnerKind::HeapArena, 0 }, pageMap);
+    }
+
+    auto allocBlock = [&](size_t size, uint32_t alignment) -> void*
+    {
+        size_t alignedSize = alignment > 8 ? (size + alignment - 1) & ~size_t(alignment - 1) : size;
+        if (alignedSize <= s_MaxSmallObjectSize && GetSizeClassBlockSize(GetSizeClass(alignedSize)) % std::max<uint32_t>(alignment, 8) == 0)
+        {
+            if (void* ptr = pClasses[GetSizeClass(alignedSize)]->alloc())
+                return ptr;
+        }
+        return alignment > 8 ? arena.alloc(std::max<size_t>(size, 1), alignment) : arena.alloc(std::max<size_t>(size, 1));
+    };
+    auto freeBlock = [&](void* ptr)
+    {
+        PageOwner owner = pageMap.Lookup(ptr);
+        if (owner.Kind == PageOwnerKind::SizeClass)
+        {
+            pClasses[owner.Index]->free(ptr);
+        }
+        else
+        {
+            arena.free(ptr);
+        }
+    };
+    auto reallocBlock = [&](void* ptr, size_t oldSize, size_t size) -> void*
+    {
+        PageOwner owner = pageMap.Lookup(ptr);
+        if (owner.Kind != PageOwnerKind::SizeClass)
+            return arena.Realloc(ptr, size);
+        if (size <= pClasses[owner.Index]->GetBlockSize())
+            return ptr;
+
+        void* pNew = allocBlock(size, 0);
+        if (!pNew)
+            return nullptr;
+        memcpy(pNew, ptr, std::min(oldSize, size));
+        freeBlock(ptr);
+        return pNew;
+    };
+
+    ReplayResult result = ReplayOps(trace, allocBlock, freeBlock, reallocBlock,
+        [&]() { return arena.GetHeapManager()->GetCommittedSize(); });
+
+    for (SlabAllocator* pClass : pClasses)
+    {
+        delete pClass;
+    }
+    return result;
+}
+
+// The process heap, with the resident memory it adds as its footprint. It
+// only guarantees 16-byte alignment.
+static ReplayResult ReplaySystemHeap(const ReplayTrace& trace)
+{
+    size_t residentBefore = GetResidentMemoryBytes();
+    return ReplayOps(trace,
+        [&](size_t size, uint32_t) { return SystemHeapAlloc(std::max<size_t>(size, 1)); },
+        [&](void* ptr) { SystemHeapFree(ptr); },
+        [&](void* ptr, size_t, size_t size) { return SystemHeapRealloc(ptr, size); },
+        [&]() { size_t resident = GetResidentMemoryBytes(); return resident > residentBefore ? resident - residentBefore : 0; });
+}
+
+bool ReplayAllocationTrace(const char* pPath)
+{
+    ReplayTrace trace;
+    if (!LoadReplayTrace(pPath, trace))
+        return false;
+
+    printf("\nReplay of %s: %zu calls from %zu threads over %.1f ms, %zu objects, peak live %zu KB, %zu unmatched events\n",
+        pPath, trace.Ops.size(), trace.NumThreads, trace.DurationNs / 1e6, trace.NumSlots, trace.PeakLiveBytes / 1024, trace.NumUnmatched);
+    printf("%24s %12s %14s %14s %10s\n", "", "Mcalls/sec", "peak KB", "fragmentation", "failures");
+    PrintReplayResult("HeapManager", trace, ReplayHeapManager(trace));
+    PrintReplayResult("size classes + arena", trace, ReplaySizeClasses(trace));
+    PrintReplayResult("system heap", trace, ReplaySystemHeap(trace));
+
+    // What rounding each traced small request up to its class costs
+    printf("\nSize classes used by the trace\n");
+    printf("%12s %12s %14s %10s\n", "block size", "requests", "avg request", "waste");
+    for (size_t i = 0; i < s_NumSizeClasses; ++i)
+    {
+        if (trace.ClassRequests[i] == 0)
+            continue;
+
+        double averageSize = static_cast<double>(trace.ClassRequestedBytes[i]) / trace.ClassRequests[i];
+        printf("%12zu %12zu %14.1f %9.1f%%\n", GetSizeClassBlockSize(i), trace.ClassRequests[i], averageSize,
+            100.0 * (GetSizeClassBlockSize(i) - averageSize) / GetSizeClassBlockSize(i));
+    }
+    return true;
+}
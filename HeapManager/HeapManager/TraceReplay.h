@@ -0,0 +1,10 @@
+#pragma once
+
+// Replays a trace from StartAllocationTrace against a standalone HeapManager,
+// the size classes over a HeapArena (the memory system's small-object setup)
+// and the system heap, and prints the throughput, peak footprint and
+// fragmentation of each, followed by how much the size classes round the
+// traced small requests up. The threads of the trace are merged into one
+// stream in timestamp order and replayed on the calling thread. Returns false
+// if the file can't be read.
+bool ReplayAllocationTrace(const char* i_pPath);
@@ -0,0 +1,113 @@
+#include "VirtualMemory.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <Psapi.h>
+
+size_t GetVirtualPageSize()
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+}
+
+void* ReserveVirtualMemory(size_t size)
+{
+    return VirtualAlloc(nullptr, size, MEM_RESERVE, PAGE_NOACCESS);
+}
+
+void ReleaseVirtualMemory(void* pAddress, size_t)
+{
+    VirtualFree(pAddress, 0, MEM_RELEASE);
+}
+
+bool CommitVirtualMemory(void* pAddress, size_t size)
+{
+    return VirtualAlloc(pAddress, size, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+}
+
+void* MapVirtualMemory(size_t size)
+{
+    return VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+}
+
+// There is no mremap equivalent, callers fall back to copying
+void* RemapVirtualMemory(void*, size_t, size_t)
+{
+    return nullptr;
+}
+
+// MEM_RESET is the counterpart of MADV_DONTNEED: the pages stay committed and
+// accessible, but their contents no longer need to be kept
+void PurgeVirtualMemory(void* pAddress, size_t size)
+{
+    VirtualAlloc(pAddress, size, MEM_RESET, PAGE_READWRITE);
+}
+
+size_t GetResidentMemoryBytes()
+{
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return counters.WorkingSetSize;
+}
+
+#else
+#include <cstdio>
+#include <sys/mman.h>
+#include <unistd.h>
+
+size_t GetVirtualPageSize()
+{
+    return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+void* ReserveVirtualMemory(size_t size)
+{
+    void* pAddress = mmap(nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return pAddress == MAP_FAILED ? nullptr : pAddress;
+}
+
+void ReleaseVirtualMemory(void* pAddress, size_t size)
+{
+    munmap(pAddress, size);
+}
+
+bool CommitVirtualMemory(void* pAddress, size_t size)
+{
+    return mprotect(pAddress, size, PROT_READ | PROT_WRITE) == 0;
+}
+
+void* MapVirtualMemory(size_t size)
+{
+    void* pAddress = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return pAddress == MAP_FAILED ? nullptr : pAddress;
+}
+
+void* RemapVirtualMemory(void* pAddress, size_t oldSize, size_t newSize)
+{
+    void* pNewAddress = mremap(pAddress, oldSize, newSize, MREMAP_MAYMOVE);
+    return pNewAddress == MAP_FAILED ? nullptr : pNewAddress;
+}
+
+void PurgeVirtualMemory(void* pAddress, size_t size)
+{
+    madvise(pAddress, size, MADV_DONTNEED);
+}
+
+size_t GetResidentMemoryBytes()
+{
+    size_t totalPages = 0;
+    size_t residentPages = 0;
+    FILE* pFile = fopen("/proc/self/statm", "r");
+    if (!pFile)
+        return 0;
+    if (fscanf(pFile, "%zu %zu", &totalPages, &residentPages) != 2)
+    {
+        residentPages = 0;
+    }
+    fclose(pFile);
+    return residentPages * GetVirtualPageSize();
+}
+
+#endif
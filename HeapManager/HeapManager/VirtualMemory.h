@@ -0,0 +1,30 @@
+#pragma once
+#include <cstddef>
+
+// Thin wrappers over the OS virtual memory calls (VirtualAlloc on Windows,
+// mmap/madvise elsewhere) for heaps that reserve address space up front and
+// commit it as they grow. Sizes and addresses are multiples of the page size.
+size_t GetVirtualPageSize();
+
+// Reserves address space without backing it; nullptr on failure
+void* ReserveVirtualMemory(size_t i_Size);
+void ReleaseVirtualMemory(void* i_pAddress, size_t i_Size);
+
+// Makes reserved pages readable and writable
+bool CommitVirtualMemory(void* i_pAddress, size_t i_Size);
+
+// Reserves and commits in one call; nullptr on failure
+void* MapVirtualMemory(size_t i_Size);
+
+// Resizes a mapping from MapVirtualMemory, moving it if it can't grow in
+// place. The pages are moved, not copied. Returns the new address, or nullptr
+// if the OS can't remap (Windows) or is out of memory; the old mapping is then
+// left untouched.
+void* RemapVirtualMemory(void* i_pAddress, size_t i_OldSize, size_t i_NewSize);
+
+// Lets the OS take the physical pages back while keeping them committed: the
+// next touch gets a fresh page and the old contents are lost
+void PurgeVirtualMemory(void* i_pAddress, size_t i_Size);
+
+// Physical memory currently used by the process
+size_t GetResidentMemoryBytes();
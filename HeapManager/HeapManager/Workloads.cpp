@@ -0,0 +1,390 @@
+#include "Workloads.h"
+#include "MemorySystem.h"
+#include "Platform.h"
+#include "VirtualMemory.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Every s_SampleInterval-th call of a workload is timed on its own for the
+// latency percentiles; timing every call would cost more than the calls
+static const size_t s_SampleInterval = 16;
+static const size_t s_MaxWorkloadThreads = 8;
+
+struct WorkloadAllocator {
+    const char* Name;
+    void* (*Alloc)(size_t);
+    void (*Free)(void*);
+};
+
+static const WorkloadAllocator s_WorkloadAllocators[] = {
+    { "memory system", malloc, free },
+    { "system heap", SystemHeapAlloc, SystemHeapFree },
+};
+
+// Calls and sampled latencies of one workload thread
+struct WorkloadCounters {
+    size_t Calls = 0;
+    vector<double> Latencies;
+
+    void* Alloc(const WorkloadAllocator& Allocator, size_t Size)
+    {
+        if (Calls++ % s_SampleInterval != 0)
+            return Allocator.Alloc(Size);
+
+        auto start = chrono::steady_clock::now();
+        void* ptr = Allocator.Alloc(Size);
+        Latencies.push_back(static_cast<double>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count()));
+        return ptr;
+    }
+
+    void Free(const WorkloadAllocator& Allocator, void* ptr)
+    {
+        if (Calls++ % s_SampleInterval != 0)
+        {
+            Allocator.Free(ptr);
+            return;
+        }
+
+        auto start = chrono::steady_clock::now();
+        Allocator.Free(ptr);
+        Latencies.push_back(static_cast<double>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count()));
+    }
+};
+
+// Polls the resident memory on its own thread while a workload runs
+class ResidentMemorySampler
+{
+private:
+    size_t m_Baseline;
+    size_t m_Peak;
+    atomic<bool> m_Stop;
+    thread m_Thread;
+
+public:
+    ResidentMemorySampler()
+        : m_Baseline(GetResidentMemoryBytes()), m_Peak(m_Baseline), m_Stop(false)
+    {
+        m_Thread = thread([this]
+        {
+            while (!m_Stop.load(memory_order_relaxed))
+            {
+                m_Peak = max(m_Peak, GetResidentMemoryBytes());
+                this_thread::sleep_for(chrono::milliseconds(1));
+            }
+        });
+    }
+
+    // Peak resident bytes above the starting point
+    size_t Stop()
+    {
+        m_Stop.store(true, memory_order_relaxed);
+        m_Thread.join();
+        m_Peak = max(m_Peak, GetResidentMemoryBytes());
+        return m_Peak - m_Baseline;
+    }
+};
+
+static size_t GetWorkloadThreadCount()
+{
+    size_t hardwareThreads = thread::hardware_concurrency();
+    return clamp<size_t>(hardwareThreads, 2, s_MaxWorkloadThreads);
+}
+
+// Runs the workload once under each allocator, with a WorkloadCounters for
+// each of its threads, and prints a row for each
+template<typename Body>
+static void RunWorkload(const char* Label, size_t ThreadCount, Body Run)
+{
+    for (const WorkloadAllocator& allocator : s_WorkloadAllocators)
+    {
+        vector<WorkloadCounters> counters(ThreadCount);
+        ResidentMemorySampler sampler;
+
+        auto start = chrono::steady_clock::now();
+        Run(allocator, counters);
+        double elapsedNs = static_cast<double>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+        size_t peakResident = sampler.Stop();
+
+        size_t calls = 0;
+        vector<double> latencies;
+        for (WorkloadCounters& threadCounters : counters)
+        {
+            calls += threadCounters.Calls;
+            latencies.insert(latencies.end(), threadCounters.Latencies.begin(), threadCounters.Latencies.end());
+        }
+        sort(latencies.begin(), latencies.end());
+
+        auto percentile = [&](double fraction) { return latencies.empty() ? 0.0 : latencies[static_cast<size_t>(fraction * (latencies.size() - 1))]; };
+        printf("%-26s %-14s %10.2f %9.0f %9.0f %9.0f %12.1f\n", Label, allocator.Name, calls * 1000.0 / elapsedNs,
+            percentile(0.5), percentile(0.99), percentile(0.999), peakResident / (1024.0 * 1024.0));
+    }
+}
+
+// Runs Worker(threadIndex) on ThreadCount threads and waits for them
+template<typename Worker>
+static void RunThreads(size_t ThreadCount, Worker Work)
+{
+    vector<thread> threads;
+    threads.reserve(ThreadCount);
+    for (size_t i = 0; i < ThreadCount; ++i)
+    {
+        threads.emplace_back(Work, i);
+    }
+    for (thread& t : threads)
+    {
+        t.join();
+    }
+}
+
+void RunWorkloads(uint32_t Seed)
+{
+    InitializeMemorySystem(size_t(4) << 30, static_cast<unsigned int>(GetWorkloadThreadCount()));
+
+    printf("\nStandard workloads (seed %u, %zu threads, latencies of every %zuth call)\n", Seed, GetWorkloadThreadCount(), s_SampleInterval);
+    printf("%-26s %-14s %10s %9s %9s %9s %12s\n", "workload", "allocator", "Mops/sec", "p50 ns", "p99 ns", "p99.9 ns", "peak RSS MB");
+
+    RunSmallObjectChurnWorkload(Seed);
+    RunLarsonWorkload(Seed);
+    RunThreadTestWorkload(Seed);
+    RunProducerConsumerWorkload(Seed);
+    RunMixedSizeSweepWorkload(Seed);
+
+    DestroyMemorySystem();
+}
+
+// One thread replacing random blocks of 8 to 256 bytes in a pool of live ones
+void RunSmallObjectChurnWorkload(uint32_t Seed)
+{
+    const size_t liveBlocks = 1024;
+    const size_t replacements = 2000000;
+
+    RunWorkload("small-object churn", 1, [&](const WorkloadAllocator& Allocator, vector<WorkloadCounters>& Counters)
+    {
+        WorkloadCounters& counters = Counters[0];
+        counters.Latencies.reserve(2 * replacements / s_SampleInterval + 1);
+        mt19937 rng(Seed);
+        vector<void*> live(liveBlocks, nullptr);
+
+        for (size_t i = 0; i < replacements; ++i)
+        {
+            size_t slot = rng() % liveBlocks;
+            if (live[slot])
+            {
+                counters.Free(Allocator, live[slot]);
+            }
+            live[slot] = counters.Alloc(Allocator, 8 + rng() % 249);
+        }
+        for (void* ptr : live)
+        {
+            if (ptr)
+            {
+                Allocator.Free(ptr);
+            }
+        }
+    });
+}
+
+// Larson: each thread replaces random blocks of 16 to 128 bytes in its own
+// array, then hands the array to a fresh thread for the next round, so blocks
+// are freed by threads other than the one that allocated them
+void RunLarsonWorkload(uint32_t Seed)
+{
+    const size_t threadCount = GetWorkloadThreadCount();
+    const size_t blocksPerThread = 1000;
+    const size_t rounds = 10;
+    const size_t replacementsPerRound = 50000;
+
+    RunWorkload("larson", threadCount, [&](const WorkloadAllocator& Allocator, vector<WorkloadCounters>& Counters)
+    {
+        vector<vector<void*>> arrays(threadCount, vector<void*>(blocksPerThread, nullptr));
+        for (WorkloadCounters& counters : Counters)
+        {
+            counters.Latencies.reserve(2 * rounds * replacementsPerRound / s_SampleInterval + 1);
+        }
+
+        for (size_t round = 0; round < rounds; ++round)
+        {
+            RunThreads(threadCount, [&](size_t threadIndex)
+            {
+                WorkloadCounters& counters = Counters[threadIndex];
+                vector<void*>& live = arrays[threadIndex];
+                mt19937 rng(Seed + static_cast<uint32_t>(round * threadCount + threadIndex));
+
+                for (size_t i = 0; i < replacementsPerRound; ++i)
+                {
+                    size_t slot = rng() % blocksPerThread;
+                    if (live[slot])
+                    {
+                        counters.Free(Allocator, live[slot]);
+                    }
+                    live[slot] = counters.Alloc(Allocator, 16 + rng() % 113);
+                }
+            });
+        }
+
+        for (vector<void*>& live : arrays)
+        {
+            for (void* ptr : live)
+            {
+                if (ptr)
+                {
+                    Allocator.Free(ptr);
+                }
+            }
+        }
+    });
+}
+
+// threadtest: every thread allocates a batch of 64-byte blocks and frees it
+// again, the total work split evenly between the threads
+void RunThreadTestWorkload(uint32_t)
+{
+    const size_t threadCount = GetWorkloadThreadCount();
+    const size_t batchSize = 1000;
+    const size_t totalBatches = 4000;
+    const size_t blockSize = 64;
+
+    RunWorkload("threadtest", threadCount, [&](const WorkloadAllocator& Allocator, vector<WorkloadCounters>& Counters)
+    {
+        RunThreads(threadCount, [&](size_t threadIndex)
+        {
+            WorkloadCounters& counters = Counters[threadIndex];
+            size_t batches = totalBatches / threadCount;
+            counters.Latencies.reserve(2 * batches * batchSize / s_SampleInterval + 1);
+            vector<void*> blocks(batchSize);
+
+            for (size_t batch = 0; batch < batches; ++batch)
+            {
+                for (void*& ptr : blocks)
+                {
+                    ptr = counters.Alloc(Allocator, blockSize);
+                }
+                for (void* ptr : blocks)
+                {
+                    counters.Free(Allocator, ptr);
+                }
+            }
+        });
+    });
+}
+
+// xmalloc-style: half the threads allocate blocks of 16 to 512 bytes and pass
+// them in batches through a bounded queue to the other half, which free them
+void RunProducerConsumerWorkload(uint32_t Seed)
+{
+    const size_t threadCount = GetWorkloadThreadCount();
+    const size_t producerCount = threadCount / 2;
+    const size_t batchSize = 64;
+    const size_t batchesPerProducer = 20000;
+    const size_t maxQueuedBatches = 64;
+
+    RunWorkload("xmalloc producer/consumer", producerCount * 2, [&](const WorkloadAllocator& Allocator, vector<WorkloadCounters>& Counters)
+    {
+        mutex queueMutex;
+        condition_variable queueChanged;
+        vector<vector<void*>> queue;
+        size_t producersLeft = producerCount;
+
+        RunThreads(producerCount * 2, [&](size_t threadIndex)
+        {
+            WorkloadCounters& counters = Counters[threadIndex];
+            counters.Latencies.reserve(batchesPerProducer * batchSize / s_SampleInterval + 1);
+
+            if (threadIndex < producerCount)
+            {
+                mt19937 rng(Seed + static_cast<uint32_t>(threadIndex));
+                for (size_t batch = 0; batch < batchesPerProducer; ++batch)
+                {
+                    vector<void*> blocks(batchSize);
+                    for (void*& ptr : blocks)
+                    {
+                        ptr = counters.Alloc(Allocator, 16 + rng() % 497);
+                    }
+
+                    unique_lock<mutex> lock(queueMutex);
+                    queueChanged.wait(lock, [&] { return queue.size() < maxQueuedBatches; });
+                    queue.push_back(move(blocks));
+                    queueChanged.notify_all();
+                }
+
+                lock_guard<mutex> lock(queueMutex);
+                --producersLeft;
+                queueChanged.notify_all();
+                return;
+            }
+
+            for (;;)
+            {
+                vector<void*> blocks;
+                {
+                    unique_lock<mutex> lock(queueMutex);
+                    queueChanged.wait(lock, [&] { return !queue.empty() || producersLeft == 0; });
+                    if (queue.empty())
+                        return;
+                    blocks = move(queue.back());
+                    queue.pop_back();
+                    queueChanged.notify_all();
+                }
+                for (void* ptr : blocks)
+                {
+                    counters.Free(Allocator, ptr);
+                }
+            }
+        });
+    });
+}
+
+// One thread churning a pool of same-size blocks, for sizes from the small
+// classes up past the huge threshold; fewer calls for the bigger sizes
+void RunMixedSizeSweepWorkload(uint32_t Seed)
+{
+    const size_t sizes[] = { 16, 64, 256, 1024, 4096, 16384, 65536, 262144, 1048576 };
+    const size_t liveBlocks = 64;
+    const size_t bytesPerSize = size_t(16) << 30;
+
+    for (size_t size : sizes)
+    {
+        size_t replacements = clamp<size_t>(bytesPerSize / size, 2000, 500000);
+        char label[32];
+        snprintf(label, sizeof(label), "sweep %zu B", size);
+
+        RunWorkload(label, 1, [&](const WorkloadAllocator& Allocator, vector<WorkloadCounters>& Counters)
+        {
+            WorkloadCounters& counters = Counters[0];
+            counters.Latencies.reserve(2 * replacements / s_SampleInterval + 1);
+            mt19937 rng(Seed);
+            vector<void*> live(liveBlocks, nullptr);
+
+            for (size_t i = 0; i < replacements; ++i)
+            {
+                size_t slot = rng() % liveBlocks;
+                if (live[slot])
+                {
+                    counters.Free(Allocator, live[slot]);
+                }
+                // Touch the first byte so the block is really mapped
+                live[slot] = counters.Alloc(Allocator, size);
+                if (live[slot])
+                {
+                    *static_cast<char*>(live[slot]) = 1;
+                }
+            }
+            for (void* ptr : live)
+            {
+                if (ptr)
+                {
+                    Allocator.Free(ptr);
+                }
+            }
+        });
+    }
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <cstdint>
+
+static const uint32_t s_DefaultWorkloadSeed = 42;
+
+// Standard allocator workloads, run with "HeapManager --workloads [seed]":
+// small-object churn, larson, threadtest, an xmalloc-style producer/consumer
+// and a mixed-size sweep. Each runs against the memory system's malloc/free
+// and against the system heap with the same seeded random sequence, and
+// prints ops/sec, latency percentiles of sampled calls and the peak resident
+// memory the run added. Initializes and destroys its own OS-backed memory system.
+void RunWorkloads(uint32_t i_Seed);
+
+void RunSmallObjectChurnWorkload(uint32_t i_Seed);
+void RunLarsonWorkload(uint32_t i_Seed);
+void RunThreadTestWorkload(uint32_t i_Seed);
+void RunProducerConsumerWorkload(uint32_t i_Seed);
+void RunMixedSizeSweepWorkload(uint32_t i_Seed);
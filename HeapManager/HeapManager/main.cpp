@@ -1,10 +1,16 @@
-#include <Windows.h>
 #include "MemorySystem.h"
+#include "AllocationTrace.h"
+#include "Benchmarks.h"
+#include "HugeAllocator.h"
+#include "Platform.h"
+#include "TraceReplay.h"
+#include "Workloads.h"
 
 #include <assert.h>
 #include <algorithm>
 #include <vector>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
 
 #ifdef _DEBUG
@@ -13,11 +19,37 @@
 #include <crtdbg.h>
 #endif
 
-// Forward declaration of our test function
-bool RunMemorySystemTests();
+// Forward declaration of our test function; DeferCoalescing runs it with the
+// arenas leaving frees unmerged between budgeted collections
+bool RunMemorySystemTests(bool DeferCoalescing);
 
 int main(int argumentCount, char** argumentValues)
 {
+    // "--bench" runs the allocator benchmarks instead of the memory system test
+    if (argumentCount > 1 && strcmp(argumentValues[1], "--bench") == 0)
+    {
+        RunBenchmarks();
+        return 0;
+    }
+
+    // "--workloads [seed]" runs the standard allocator workloads against the
+    // memory system and the system heap
+    if (argumentCount > 1 && strcmp(argumentValues[1], "--workloads") == 0)
+    {
+        RunWorkloads(argumentCount > 2 ? strtoul(argumentValues[2], nullptr, 10) : s_DefaultWorkloadSeed);
+        return 0;
+    }
+
+    // "--replay <file>" replays a trace recorded with "--trace <file>"
+    if (argumentCount > 2 && strcmp(argumentValues[1], "--replay") == 0)
+    {
+        InitializeMemorySystem(size_t(1) << 30);
+        bool replayed = ReplayAllocationTrace(argumentValues[2]);
+        DestroyMemorySystem();
+        return replayed ? 0 : 1;
+    }
+    const char* pTracePath = argumentCount > 2 && strcmp(argumentValues[1], "--trace") == 0 ? argumentValues[2] : nullptr;
+
     // We can seed our RNG here to ensure different random outcomes on each run
     srand(static_cast<unsigned int>(time(nullptr)));
 
@@ -28,21 +60,40 @@ int main(int argumentCount, char** argumentValues)
     const unsigned int descriptorCount = 2048;
 
     // Allocate memory for the heap
-    void* pMainHeapMemory = HeapAlloc(GetProcessHeap(), 0, memHeapSize);
+    void* pMainHeapMemory = SystemHeapAlloc(memHeapSize);
     assert(pMainHeapMemory);
 
     // Initialize our custom MemorySystem (HeapManager + possible FixedSizeAllocators)
     InitializeMemorySystem(pMainHeapMemory, memHeapSize, descriptorCount);
 
-    // Run the memory test
-    bool testOutcome = RunMemorySystemTests();
+    // Run the memory test, recording its allocations if asked to
+    if (pTracePath)
+    {
+        StartAllocationTrace(pTracePath);
+    }
+    bool testOutcome = RunMemorySystemTests(false);
+    assert(testOutcome);
+    if (pTracePath)
+    {
+        StopAllocationTrace();
+    }
+
+    // Run it again with deferred coalescing: frees are merged by the test's
+    // budgeted collections, or when an allocation finds no fit
+    SetDeferredCoalescing(true);
+    testOutcome = RunMemorySystemTests(true);
     assert(testOutcome);
+    SetDeferredCoalescing(false);
+    Collect();
+
+    // Report what the test left behind before tearing down
+    DumpStatsJson(GetStats(), stdout);
 
     // Clean up our Memory System
     DestroyMemorySystem();
 
     // Free the raw heap memory
-    HeapFree(GetProcessHeap(), 0, pMainHeapMemory);
+    SystemHeapFree(pMainHeapMemory);
 
 #if defined(_DEBUG)
     // Report memory leaks in Debug mode
@@ -52,7 +103,7 @@ int main(int argumentCount, char** argumentValues)
     return 0;
 }
 
-bool RunMemorySystemTests()
+bool RunMemorySystemTests(bool DeferCoalescing)
 {
     // We'll cap our maximum random allocations
     const size_t maxPossibleAllocs = 10 * 1024;
@@ -94,6 +145,7 @@ bool RunMemorySystemTests()
         // Periodically free or collect to simulate real usage
         const unsigned int freeChance = 0x07;
         const unsigned int collectChance = 0x07;
+        const size_t collectBudget = 64;   // blocks walked per periodic collection
         bool shouldFreeBlock = (!allocatedBlocks.empty() && (rand() % freeChance == 0));
         bool shouldCollectNow = (rand() % collectChance == 0);
 
@@ -108,7 +160,14 @@ bool RunMemorySystemTests()
         }
         else if (shouldCollectNow)
         {
-            Collect();
+            if (DeferCoalescing)
+            {
+                Collect(collectBudget);
+            }
+            else
+            {
+                Collect();
+            }
             ++collectCount;
         }
 
@@ -133,8 +192,12 @@ bool RunMemorySystemTests()
         // Perform a final collection to ensure big contiguous block
         Collect();
 
-        // Test if we can allocate a large block now
+        // Test if we can allocate a large block now. It is above the huge
+        // threshold, which would map it from the OS, so lift the threshold to
+        // make the heap itself provide it.
+        SetHugeAllocationThreshold(SIZE_MAX);
         void* pLargeTestBlock = malloc(totalMemoryAllocated / 2);
+        SetHugeAllocationThreshold(HugeAllocator::s_DefaultThreshold);
 
         if (pLargeTestBlock)
         {